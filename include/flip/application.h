@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <span>
 
 // User is expected to implement this function to instantiate its
 // flip::Application implementation.
@@ -15,6 +16,8 @@ struct sapp_event;
 
 namespace flip {
 class Renderer;
+class JobSystem;
+struct ImMode;
 
 // Base application interface.
 class Application {
@@ -28,10 +31,26 @@ class Application {
     int sample_count = 4;
     bool high_dpi = true;
     const char* title = "Flip application";
+
+    // ImDraw modes used by the application, whose pipelines are built at
+    // initialization.
+    std::span<const ImMode> im_modes = {};
+
+    // Batches ImDraw scopes, see ImDraw for the draw order contract.
+    bool batch_imdraw = false;
+
+    // Pipelined frame mode, where Update runs on a worker one frame ahead of
+    // Display. Other functions (Display, Menu, Gui, Event) run on the main
+    // thread concurrently to Update, so they must not access state modified
+    // by Update. Update results are rather published with Publish().
+    bool pipelined = false;
   };
   Application(const Settings& _settings) : settings_{_settings} {}
   const auto& settings() const { return settings_; }
 
+  // Job system, available from Initialize() to application destruction.
+  JobSystem& jobs() const { return *jobs_; }
+
   // Enumeration of application update loop return modes.
   enum class LoopControl {
     kContinue,      // Continue with next loop.
@@ -46,6 +65,11 @@ class Application {
     return LoopControl::kContinue;
   }
 
+  // In pipelined mode, called on the main thread once Update completed and
+  // before it's started again. Application publishes Update results (copies
+  // or swaps them) to the render snapshot used by Display.
+  virtual void Publish() {}
+
   virtual bool Display(Renderer& _renderer) { return true; }
   virtual bool Menu() { return true; }
   virtual bool Gui() { return true; }
@@ -56,6 +80,9 @@ class Application {
   // Application global settings.
   const Settings settings_;
 
+  // Owned by ApplicationCb.
+  JobSystem* jobs_ = nullptr;
+
   // ApplicationCb is the only one allowed to call private interface
   // functions
   friend class ApplicationCb;
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "flip/imdraw.h"
+#include "flip/renderer.h"
+
+namespace flip {
+
+// Records ImDraw scopes and DrawShapes calls, without touching the GPU, so
+// they can be submitted to the renderer later. A buffer must only be used by
+// one thread at a time, see CommandList to record from many threads.
+class CommandBuffer : public ImDrawTarget {
+ public:
+  // Sort key of the next recorded commands. Commands are rendered in key
+  // order, then in recording order.
+  void key(uint32_t _key) { key_ = _key; }
+  uint32_t key() const { return key_; }
+
+  // Records shapes rendering, see Renderer::DrawShapes.
+  void DrawShape(const HMM_Mat4& _transform, Renderer::Shape _shape,
+                 Color _color) {
+    DrawShapes({&_transform, 1}, _shape, _color);
+  }
+  void DrawShapes(std::span<const HMM_Mat4> _transforms, Renderer::Shape _shape,
+                  Color _color);
+  void DrawShapes(std::span<const HMM_Mat4> _transforms,
+                  std::span<const Color> _colors, Renderer::Shape _shape);
+
+  // Discards all commands, keeping memory for the next recording.
+  void Clear();
+
+  bool empty() const { return commands_.empty(); }
+
+ private:
+  friend class CommandList;
+
+  virtual void BeginImDraw(const HMM_Mat4& _transform,
+                           const ImMode& _mode) override;
+  virtual std::span<ImVertex> ReallocateImVertices(
+      std::span<ImVertex> _vertices, size_t _count) override;
+  virtual void EndImDraw(std::span<const ImVertex> _vertices, sg_image _image,
+                         sg_sampler _sampler) override;
+
+  struct Command {
+    enum Type : uint8_t { kImDraw, kShapes } type;
+    uint32_t key;
+
+    // Range of vertices (kImDraw) or transforms (kShapes).
+    uint32_t first;
+    uint32_t count;
+
+    // kImDraw
+    HMM_Mat4 transform;
+    ImMode mode;
+    sg_image image;
+    sg_sampler sampler;
+
+    // kShapes, colors is the first color, or ~0 for a uniform color.
+    Renderer::Shape shape;
+    Color color;
+    uint32_t colors;
+  };
+  std::vector<Command> commands_;
+
+  // Commands data.
+  std::vector<ImVertex> vertices_;
+  std::vector<HMM_Mat4> transforms_;
+  std::vector<Color> colors_;
+
+  uint32_t key_ = 0;
+
+  // Command of the ImDraw scope being recorded, if any.
+  static constexpr size_t kNoScope = ~size_t{0};
+  size_t scope_ = kNoScope;
+};
+
+// Set of command buffers, one per recording thread. Commands of all buffers
+// are merged when rendered, ordered by key, then buffer, then recording
+// order. As threads running jobs aren't deterministic, each job should use
+// its own keys for the order to be deterministic.
+class CommandList {
+ public:
+  // Returns the buffer of the calling thread. Thread safe, but locks, so the
+  // reference should be kept while recording.
+  CommandBuffer& buffer();
+
+  // Discards all commands. Not thread safe, no buffer can be recording.
+  void Clear();
+
+  // Renders all commands, in order. Must be called during the default pass,
+  // which Renderer::Submit does.
+  bool Replay(Renderer& _renderer) const;
+
+ private:
+  struct Entry {
+    std::thread::id thread;
+    std::unique_ptr<CommandBuffer> buffer;
+  };
+  std::vector<Entry> buffers_;
+  mutable std::mutex mutex_;
+
+  // Merged commands (buffer, command) indices, reused by Replay.
+  mutable std::vector<std::pair<uint32_t, uint32_t>> order_;
+};
+
+}  // namespace flip
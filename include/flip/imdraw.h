@@ -2,7 +2,8 @@
 
 // Explicitly exposes sokol includes and data structures which are supposed to
 // be used directly from user side
-#include <vector>
+#include <algorithm>
+#include <span>
 
 #include "flip/math.h"
 #include "flip/renderer.h"
@@ -10,6 +11,15 @@
 
 namespace flip {
 
+// Vertex format used to upload ImDraw vertices to the GPU. Recording API is
+// the same for all formats, vertices are packed when they are uploaded.
+enum class ImFormat {
+  kFull,      // float3 position, float4 color, float2 uv, float size (40 B).
+  kPacked,    // float3 position, ubyte4n color (16 B), and size for points.
+  kPackedUv,  // float3 position, ubyte4n color, half2 uv (20 B), and size
+              // for points.
+};
+
 struct ImMode {
   // Primitive type
   sg_primitive_type type = SG_PRIMITIVETYPE_TRIANGLES;
@@ -25,6 +35,9 @@ struct ImMode {
   bool alpha_blending = false;
   bool alpha_test = false;
   bool alpha_to_coverage = false;
+
+  // Vertex format, packed formats reduce bandwidth for untextured geometry.
+  ImFormat format = ImFormat::kFull;
 };
 
 struct ImVertex {
@@ -34,14 +47,34 @@ struct ImVertex {
   float size = 1.f;               // Point size primitive
 };
 
-// RAII to begin/end an immediate mode draw
+// RAII to begin/end an immediate mode draw. _target is either a Renderer,
+// or a CommandBuffer to record the draw from any thread.
+// By default, a scope is rendered when it ends. When batching is enabled (see
+// Renderer::BatchImDraw), scopes are rather rendered together, before the
+// next renderer draw (DrawShapes, DrawAxes, DrawGrids) or at the end of the
+// pass. Order with renderer draws is preserved, but pass state and sokol
+// draws issued by the application meanwhile don't apply to batched scopes,
+// unless Renderer::FlushImDraw() is called first.
 class ImDraw {
  public:
-  ImDraw(Renderer& _renderer, const HMM_Mat4& _transform, const ImMode& _mode)
-      : renderer_(_renderer) {
-    renderer_.BeginImDraw(_transform, _mode);
+  ImDraw(ImDrawTarget& _target, const HMM_Mat4& _transform,
+         const ImMode& _mode)
+      : target_(_target) {
+    target_.BeginImDraw(_transform, _mode);
+  }
+  ~ImDraw() {
+    // Releases unused capacity.
+    auto vertices = target_.ReallocateImVertices(vertices_.first(size_), size_);
+    target_.EndImDraw(vertices, image_, sampler_);
+  }
+
+  // Preallocates memory for a total of _count vertices, so that submitting
+  // them won't reallocate.
+  void reserve(size_t _count) {
+    if (_count > vertices_.size()) {
+      vertices_ = target_.ReallocateImVertices(vertices_.first(size_), _count);
+    }
   }
-  ~ImDraw() { renderer_.EndImDraw(vertices_, image_, sampler_); }
 
   void texture(sg_image _image, sg_sampler _sampler) {
     image_ = _image;
@@ -125,13 +158,29 @@ class ImDraw {
     Submit();
   }
 
+  // Submits a range of vertices at once. Current (internal) vertex is left
+  // unchanged.
+  void vertices(std::span<const ImVertex> _vertices) {
+    reserve(size_ + _vertices.size());
+    std::copy(_vertices.begin(), _vertices.end(), vertices_.begin() + size_);
+    size_ += _vertices.size();
+  }
+
  private:
   // Submit new vertex for the primitive
-  void Submit() { vertices_.push_back(vertex_); }
+  void Submit() {
+    if (size_ == vertices_.size()) {
+      reserve(std::max(size_ * 2, size_t{64}));
+    }
+    vertices_[size_++] = vertex_;
+  }
 
-  Renderer& renderer_;
+  ImDrawTarget& target_;
 
-  std::vector<ImVertex> vertices_;
+  // Vertices storage, allocated by the target, and the number of vertices
+  // submitted.
+  std::span<ImVertex> vertices_;
+  size_t size_ = 0;
   ImVertex vertex_;
   sg_image image_ = {SG_INVALID_ID};
   sg_sampler sampler_ = {SG_INVALID_ID};
@@ -1,4 +1,6 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <span>
 
 // math
@@ -13,6 +15,7 @@ namespace flip {
 struct CameraView;
 struct ImMode;
 struct ImVertex;
+class CommandList;
 
 union Color {
   struct {
@@ -21,6 +24,26 @@ union Color {
   float rgba[4];
 };
 
+// Compact instance transforms, alternatives to HMM_Mat4 for DrawShapes.
+
+// 3x4 affine matrix, made of the 3 first rows of a HMM_Mat4 (48 B).
+struct Affine {
+  HMM_Vec4 rows[3];
+};
+
+// Translation and uniform scale (16 B).
+struct TranslationScale {
+  HMM_Vec3 translation;
+  float scale;
+};
+
+// Translation, uniform scale and rotation quaternion (32 B).
+struct TranslationRotationScale {
+  HMM_Vec3 translation;
+  float scale;
+  HMM_Quat rotation;
+};
+
 // Color constants.
 static const Color kRed = {1, 0, 0, 1};
 static const Color kGreen = {0, 1, 0, 1};
@@ -32,8 +55,28 @@ static const Color kCyan = {0, 1, 1, 1};
 static const Color kGrey = {.5f, .5f, .5f, 1};
 static const Color kBlack = {0, 0, 0, 1};
 
+// Receiver of ImDraw scopes. Renderer renders them, while CommandBuffer
+// records them for a later submission.
+class ImDrawTarget {
+ public:
+  virtual ~ImDrawTarget() = default;
+
+ private:
+  friend class ImDraw;
+  friend class CommandList;
+  virtual void BeginImDraw(const HMM_Mat4& _transform, const ImMode& _mode) = 0;
+
+  // ImDraw vertices are recorded in memory owned by the target. Resizes
+  // _vertices to _count, preserving its content. Allocations are valid until
+  // the end of the scope.
+  virtual std::span<ImVertex> ReallocateImVertices(
+      std::span<ImVertex> _vertices, size_t _count) = 0;
+  virtual void EndImDraw(std::span<const ImVertex> vertices_, sg_image _image,
+                         sg_sampler _sampler) = 0;
+};
+
 // Base Renderer interface
-class Renderer {
+class Renderer : public ImDrawTarget {
  public:
   virtual ~Renderer() = default;
 
@@ -55,6 +98,23 @@ class Renderer {
 
   virtual const HMM_Mat4& GetViewProj() const = 0;
 
+  // Builds ImDraw pipelines of all _modes up front, avoiding to create them
+  // while rendering.
+  virtual void WarmUpImModes(std::span<const ImMode> _modes) = 0;
+
+  // Total number of ImDraw pipelines created while rendering, as their mode
+  // wasn't declared for warm-up. Each of them possibly caused a hitch.
+  virtual int GetLatePipelines() const = 0;
+
+  // Enables ImDraw batching, see ImDraw for the ordering contract. Disabled
+  // by default.
+  virtual void BatchImDraw(bool _batch) = 0;
+
+  // Renders ImDraw scopes batched so far. When batching, must be called
+  // before changing pass state (scissor, viewport) or issuing sokol draws
+  // that ImDraw scopes should be ordered with.
+  virtual void FlushImDraw() = 0;
+
   // Renders shapes, as described by Shape enumeration
   enum Shape {
     kPlane,     // Size of (1, 0, 1), with origin at plane center (.5, 0, .5).
@@ -70,6 +130,38 @@ class Renderer {
   virtual bool DrawShapes(std::span<const HMM_Mat4> _transforms, Shape _shape,
                           Color _color) = 0;
 
+  // Renders shapes using compact instance transforms.
+  virtual bool DrawShapes(std::span<const Affine> _transforms, Shape _shape,
+                          Color _color) = 0;
+  virtual bool DrawShapes(std::span<const TranslationScale> _transforms,
+                          Shape _shape, Color _color) = 0;
+  virtual bool DrawShapes(std::span<const TranslationRotationScale> _transforms,
+                          Shape _shape, Color _color) = 0;
+
+  // Renders shapes with a color per instance. _colors and _transforms must
+  // have the same size.
+  virtual bool DrawShapes(std::span<const HMM_Mat4> _transforms,
+                          std::span<const Color> _colors, Shape _shape) = 0;
+
+  // Handle to retained shape instances, whose transforms are kept by the
+  // renderer in a GPU buffer. Drawing them doesn't upload anything unless
+  // transforms were updated. Handles of destroyed instances are ignored.
+  struct Instances {
+    uint32_t id = 0;
+  };
+  virtual Instances CreateInstances(std::span<const HMM_Mat4> _transforms) = 0;
+  virtual void DestroyInstances(Instances _instances) = 0;
+
+  // Updates _transforms.size() transforms, starting at instance _first. Range
+  // must be within the instances created size. Upload is deferred to the next
+  // draw, and happens at most once per frame.
+  virtual bool UpdateInstances(Instances _instances, size_t _first,
+                               std::span<const HMM_Mat4> _transforms) = 0;
+
+  // Renders retained instances. They aren't frustum culled.
+  virtual bool DrawShapes(Instances _instances, Shape _shape,
+                          Color _color) = 0;
+
   // Renders xyz coordinate system.
   bool DrawAxis(const HMM_Mat4& _transform) {
     return DrawAxes({&_transform, 1});
@@ -82,15 +174,15 @@ class Renderer {
   }
   virtual bool DrawGrids(std::span<const HMM_Mat4> _transforms, int _cells) = 0;
 
+  // Submits commands recorded to _list, possibly from other threads. They are
+  // rendered at the end of the default pass, on the calling thread. _list
+  // must be left unchanged until then.
+  virtual void Submit(const CommandList& _list) = 0;
+
  protected:
  private:
   virtual void BeginDefaultPass(const CameraView& _view) = 0;
   virtual void EndDefaultPass() = 0;
-
-  friend class ImDraw;
-  virtual void BeginImDraw(const HMM_Mat4& _transform, const ImMode& _mode) = 0;
-  virtual void EndImDraw(std::span<const ImVertex> vertices_, sg_image _image,
-                         sg_sampler _sampler) = 0;
 };
 
 }  // namespace flip
\ No newline at end of file
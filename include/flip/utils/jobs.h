@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace flip {
+
+// Graph of jobs with dependencies, executed by JobSystem::Run.
+class JobGraph {
+ public:
+  using Node = int;
+
+  // Adds a job to the graph, returning its node.
+  Node Add(std::function<void()> _job);
+
+  // _node will only run once _dependency is completed.
+  void Depend(Node _node, Node _dependency);
+
+  size_t size() const { return nodes_.size(); }
+
+ private:
+  friend class JobSystem;
+  struct Entry {
+    std::function<void()> job;
+    std::vector<Node> dependents;
+    int dependencies = 0;
+  };
+  std::vector<Entry> nodes_;
+};
+
+// Work-stealing job system. Each worker owns a queue of tasks, pops its own
+// tasks last in first out, and steals other queues tasks first in first out
+// when it's empty. Threads waiting for jobs completion (including the main
+// thread) execute tasks meanwhile, so jobs can be nested, and sleep when
+// there's none to run. Background jobs are only executed by idle workers,
+// never by waiting threads. Pending jobs are completed on destruction.
+// Without threads support (emscripten without pthreads), everything is
+// executed by the waiting thread.
+class JobSystem {
+ public:
+  // _workers is the number of worker threads, in addition to the calling
+  // thread. Negative means one less than hardware concurrency.
+  explicit JobSystem(int _workers = -1);
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  int workers() const { return static_cast<int>(threads_.size()); }
+
+  // Calls _fn(begin, end) over chunks of [0, _count) range, of _grain size (0
+  // for automatic), and waits for completion.
+  void ParallelFor(size_t _count, size_t _grain,
+                   const std::function<void(size_t, size_t)>& _fn);
+
+  // Calls _fn(element) for all _span elements, and waits for completion.
+  template <typename _Ty, typename _Fn>
+  void ParallelFor(std::span<_Ty> _span, _Fn&& _fn, size_t _grain = 0) {
+    ParallelFor(_span.size(), _grain, [&](size_t _begin, size_t _end) {
+      for (size_t i = _begin; i < _end; ++i) {
+        _fn(_span[i]);
+      }
+    });
+  }
+
+  // Runs all _graph jobs, respecting dependencies, and waits for completion.
+  // Graph must be acyclic.
+  void Run(const JobGraph& _graph);
+
+  // Counter of pending asynchronous jobs.
+  using Counter = std::atomic<int>;
+
+  // Pushes _job for asynchronous execution. _counter is incremented, and
+  // decremented once _job is completed.
+  void Submit(std::function<void()> _job, Counter& _counter);
+
+  // Same as Submit, for long jobs (like decoding) that mustn't delay threads
+  // waiting for other jobs. Without workers, _job is executed immediately.
+  void SubmitBackground(std::function<void()> _job, Counter& _counter);
+
+  // Runs tasks until _counter reaches 0, sleeping while there's none.
+  void Wait(const Counter& _counter);
+
+ private:
+  struct Task {
+    std::function<void()> fn;
+    std::atomic<int>* pending;  // Decremented once task is completed.
+  };
+
+  void Push(Task _task, bool _background = false);
+
+  // Pops or steals a task and runs it, or a background task if _background
+  // is true and no other task was found. Returns false if none was found.
+  bool TryRun(bool _background = false);
+
+  void WorkerLoop(int _queue);
+
+  // Queue 0 is shared by non-worker threads, then one per worker.
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+  std::vector<std::unique_ptr<Queue>> queues_;
+  Queue background_;
+  std::vector<std::thread> threads_;
+
+  // Idle workers sleep until tasks are queued. Waiting threads sleep until a
+  // task is queued or completed.
+  std::atomic<int> queued_ = 0;
+  std::atomic<int> background_queued_ = 0;
+  std::atomic<int> waiters_ = 0;
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  std::condition_variable waiters_wake_;
+  bool exit_ = false;
+
+  // Wakes up waiting threads, if any.
+  void WakeWaiters();
+};
+
+}  // namespace flip
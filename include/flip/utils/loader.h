@@ -1,14 +1,24 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 #include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "flip/utils/sokol_gfx.h"
 #include "sokol/sokol_fetch.h"
 
 namespace flip {
-
-// Create an asynchronous buffer reading from file.
+class JobSystem;
+
+// Create an asynchronous buffer reading from file. On native platforms, file
+// size is known up front, so the whole file is read at once to its
+// destination. Otherwise it's streamed by chunks of _buffering_size.
+// Request records and scratch buffers are pooled, so loading many small files
+// doesn't churn the allocator. Like sokol_fetch, must be used from the main
+// thread.
 class AsyncBuffer {
  public:
   AsyncBuffer() = default;
@@ -21,6 +31,29 @@ class AsyncBuffer {
   AsyncBuffer(const char* _filename, const Completion& _completion,
               size_t _buffering_size = 4 << 10);
 
+  // Callback function notifying loading success or failure, and receiving
+  // loaded buffer ownership.
+  using Transfer = std::function<void(bool, std::vector<std::byte>&& _buffer,
+                                      const char* _filename)>;
+
+  // Initiate a loading request, whose buffer is moved to _completion rather
+  // than copied.
+  static AsyncBuffer Take(const char* _filename, const Transfer& _completion,
+                          size_t _buffering_size = 4 << 10);
+
+  // Callback function receiving file chunks as they arrive, with their offset
+  // in the file. Chunk is only valid during the call. Returning false cancels
+  // loading, which then completes with a failure.
+  using Consumer =
+      std::function<bool(std::span<const std::byte> _chunk, size_t _offset)>;
+
+  // Initiate a streaming request, where the file is never assembled in
+  // memory. Chunks of _chunk_size are passed to _consumer, then _completion
+  // is notified with an empty buffer.
+  static AsyncBuffer Stream(const char* _filename, const Consumer& _consumer,
+                            const Completion& _completion,
+                            size_t _chunk_size = 64 << 10);
+
   // Immediately cancels async operation on destruction.
   ~AsyncBuffer();
 
@@ -44,13 +77,42 @@ class AsyncBuffer {
   sfetch_handle_t handle_ = {};
 };
 
-// Create image read asynchronously from a file.
+// Default number of image bytes uploaded to the GPU per frame.
+constexpr size_t kDefaultUploadBudget = 16 << 20;
+
+// Setups SgAsyncImage decoding and uploading. Images are decoded by _jobs, or
+// synchronously if nullptr. Decoded images are then uploaded by
+// UploadAsyncImages(), up to _upload_budget bytes per frame.
+// If _cache_dir isn't nullptr or empty, decoded images are cached to this
+// directory, keyed by their file content hash, so they aren't decoded again
+// on the next launches.
+void SetupAsyncImages(JobSystem* _jobs,
+                      size_t _upload_budget = kDefaultUploadBudget,
+                      const char* _cache_dir = nullptr);
+
+// Waits for images being decoded, and discards those not uploaded yet.
+void ShutdownAsyncImages();
+
+// Uploads decoded images to the GPU, within the frame budget. At least one
+// image is uploaded, so images larger than the budget still load. Must be
+// called once per frame from the main thread.
+void UploadAsyncImages();
+
+// Create image read asynchronously from a file. File is decoded off the main
+// thread, see SetupAsyncImages().
+// KTX2 and DDS files are uploaded without decoding, including compressed
+// formats (BC, ETC2, ASTC) and their mips. Other formats are decoded to RGBA8
+// with stb, and a mip chain is generated if _mips is true.
+// Images are shared by path: SgAsyncImage created for a file that's already
+// loaded or loading reference the same image, which is destroyed with the
+// last of them. Like AsyncBuffer, must be used from the main thread.
 class SgAsyncImage {
  public:
   SgAsyncImage() = default;
-  explicit SgAsyncImage(const char* _filename);
+  explicit SgAsyncImage(const char* _filename, bool _mips = true);
 
-  // Immediately cancels async operation and destroy image.
+  // Immediately cancels async operation and destroy image, if it's not shared
+  // anymore.
   ~SgAsyncImage() = default;
 
   // Movable
@@ -61,20 +123,31 @@ class SgAsyncImage {
   SgAsyncImage(const SgAsyncImage&) = delete;
   SgAsyncImage& operator=(const SgAsyncImage&) = delete;
 
-  bool is_valid() const { return image_.is_valid(); }
+  bool is_valid() const { return shared_ && shared_->image.is_valid(); }
 
-  sg_image id() const { return image_.id(); }
+  sg_image id() const { return shared_ ? shared_->image.id() : sg_image{}; }
 
  private:
   // Important to use a static function, as *this is movable.
-  // This function will only be called if buffer_ isn't deleted / cancelled.
-  // Hence it's safe to pass it image_;
-  static void Completed(sg_image _image, bool _successs,
-                        std::span<const std::byte> _buffer,
+  // This function will only be called if buffer isn't deleted / cancelled.
+  // Hence it's safe to pass it image;
+  static void Completed(sg_image _image, bool _mips, bool _successs,
+                        std::vector<std::byte>&& _buffer,
                         const char* _filename);
 
-  SgImage image_;
-  AsyncBuffer buffer_;
+  // Image and its loading request, shared by all SgAsyncImage of a file.
+  struct Shared {
+    ~Shared();
+    std::string path;
+    bool mips;
+    SgImage image;
+    AsyncBuffer buffer;
+  };
+  std::shared_ptr<Shared> shared_;
+
+  // Images being loaded or loaded, by path, with or without mips.
+  using SharedImages = std::unordered_map<std::string, std::weak_ptr<Shared>>;
+  static SharedImages& shared_images(bool _mips);
 };
 
 }  // namespace flip
@@ -2,6 +2,8 @@
 #include <array>
 #include <cstdint>
 #include <span>
+#include <utility>
+#include <vector>
 
 namespace flip {
 
@@ -29,6 +31,58 @@ struct ProfileStats {
 };
 ProfileStats stats(std::span<const float> _data);
 
+// Plots record values with imgui, with stats overlay.
+void plot(const char* _label, const ProfileRecord& _record);
+
+// Distribution of values (ms) over a sliding window, for percentiles and
+// hitches. Values are counted in fixed .1 ms bins, so pushing is O(1)
+// whatever the window size, and percentiles are precise to a bin.
+class ProfileHistogram {
+ public:
+  // Default budget is a 60 fps frame.
+  static constexpr float kDefaultBudget = 1000.f / 60.f;
+  explicit ProfileHistogram(int _window = 1024,
+                            float _budget = kDefaultBudget);
+
+  void push(float _value);
+
+  // Changes window size, which clears the histogram.
+  void resize(int _window);
+  int window() const { return static_cast<int>(window_.size()); }
+
+  // Number of values in the window.
+  int count() const { return count_; }
+
+  // Returns the upper bound of the bin containing the _p (0 to 1) percentile
+  // of the window values. Percentiles beyond bins range are exact values.
+  float percentile(float _p) const;
+
+  // Values over budget, in the window and since creation.
+  float budget() const { return budget_; }
+  void set_budget(float _budget);
+  int hitches() const { return hitches_; }
+  int total_hitches() const { return total_hitches_; }
+
+  // Renders percentiles, hitches and histogram with imgui.
+  void Gui(const char* _label);
+
+ private:
+  static constexpr float kBinWidth = .1f;
+  static constexpr int kBinCount = 1000;  // Last bin also counts overflows.
+  static int Bin(float _value);
+
+  std::array<int, kBinCount> bins_ = {0};
+
+  // Ring of window values, to evict them and resolve overflows.
+  std::vector<float> window_;
+  int offset_ = 0;
+  int count_ = 0;
+
+  float budget_;
+  int hitches_ = 0;
+  int total_hitches_ = 0;
+};
+
 class Profile {
  public:
   Profile(ProfileRecord& _record);
@@ -38,4 +92,78 @@ class Profile {
   ProfileRecord& record_;
   uint64_t start_;
 };
+
+// Hierarchical scope profiling.
+// Named scopes record begin/end events to a per thread buffer, which are
+// collected from all threads and aggregated per frame into a tree by
+// ProfileTree. Names must be strings with a static lifetime, scopes with the
+// same name and parent are merged.
+#define FLIP_PROFILE(_name) \
+  const flip::ProfileScope FLIP_PROFILE_CONCAT(flip_profile_, __LINE__)(_name)
+#define FLIP_PROFILE_CONCAT(_a, _b) FLIP_PROFILE_CONCAT_IMPL(_a, _b)
+#define FLIP_PROFILE_CONCAT_IMPL(_a, _b) _a##_b
+
+struct ProfileEvent {
+  const char* name;  // Scope name for begin events, nullptr for end events.
+  uint64_t time;     // stm_now() ticks.
+};
+
+// RAII scope, prefer FLIP_PROFILE macro.
+class ProfileScope {
+ public:
+  explicit ProfileScope(const char* _name);
+  ~ProfileScope();
+};
+
+// Events recorded by a thread.
+struct ProfileThread {
+  uint32_t id;       // Unique per thread, in order of first recording.
+  const char* name;  // See set_thread_profile_name().
+  std::vector<ProfileEvent> events;
+};
+
+// Names the calling thread in captures. _name must have a static lifetime.
+void set_thread_profile_name(const char* _name);
+
+// Moves events recorded by all threads since last collection to _threads,
+// calling thread first. Scopes still opened are left for the next
+// collection, so each thread events are complete scopes. _threads memory is
+// reused.
+void collect_profile_events(std::vector<ProfileThread>& _threads);
+
+// Tree of scopes aggregated from events.
+class ProfileTree {
+ public:
+  struct Node {
+    const char* name;
+    int parent;       // Index of parent node, -1 for roots.
+    int calls;        // Number of times the scope was entered.
+    float inclusive;  // Time spent in the scope, in ms.
+    float exclusive;  // Time spent in the scope but not in children, in ms.
+  };
+
+  // Rebuilds the tree from a frame of events. First thread scopes are roots,
+  // other threads scopes are merged below an "Other threads" root.
+  void Aggregate(std::span<const ProfileThread> _threads);
+
+  // Parents come before their children.
+  std::span<const Node> nodes() const { return nodes_; }
+
+  // Renders the tree with imgui, relatively to _frame ms.
+  void Gui(float _frame) const;
+
+ private:
+  void Gui(int _parent, float _frame) const;
+
+  // Aggregates _events below _root node (-1 for none).
+  void Aggregate(int _root, std::span<const ProfileEvent> _events);
+
+  // Finds or creates node _name below _parent.
+  int Find(int _parent, const char* _name);
+
+  std::vector<Node> nodes_;
+
+  // Opened scopes while aggregating, node index and begin time.
+  std::vector<std::pair<int, uint64_t>> stack_;
+};
 }  // namespace flip
\ No newline at end of file
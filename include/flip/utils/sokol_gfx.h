@@ -1,7 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <span>
 #include <utility>
+#include <vector>
 
 #include "sokol/sokol_gfx.h"
 
@@ -96,13 +98,47 @@ struct BufferBinding {
 };
 
 // Dynamic buffer, which size will stabilize to the minimum required each
-// frame.
+// frame. Data is appended to a sokol stream buffer, which already cycles
+// through frames in flight internally.
+// When a frame overflows the buffer, a new one is allocated with geometric
+// growth. The outgrown buffer still holds data used by draws of the current
+// and in flight frames, so its destruction is deferred.
 class SgDynamicBuffer {
  public:
+  // _reserve is a preallocation hint, in bytes per frame.
+  explicit SgDynamicBuffer(size_t _reserve = 0) : reserve_{_reserve} {}
+
+  // Ensures buffer can store at least _size bytes per frame without
+  // reallocating. Buffer is reallocated on next Append if needed.
+  void Reserve(size_t _size) { reserve_ = std::max(reserve_, _size); }
+
   BufferBinding Append(std::span<const std::byte> _data);
 
+  struct Stats {
+    size_t size;          // Current buffer size.
+    size_t frame_bytes;   // Bytes appended during the last complete frame.
+    size_t total_bytes;   // Bytes appended since creation.
+    int reallocations;    // Number of buffer (re)allocations since creation.
+  };
+  const Stats& stats() const { return stats_; }
+
  private:
   SgBuffer buffer_;
+
+  // Outgrown buffers, released once no frame in flight uses them anymore.
+  struct Retired {
+    SgBuffer buffer;
+    uint32_t frame;
+  };
+  std::vector<Retired> retired_;
+
+  size_t reserve_ = 0;
+
+  // Frame index of the last append, as tracked by sokol.
+  uint32_t frame_ = 0;
+  size_t frame_bytes_ = 0;
+
+  Stats stats_ = {};
 };
 
 }  // namespace flip
\ No newline at end of file
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "flip/utils/loader.h"
+#include "flip/utils/sokol_gfx.h"
+
+namespace flip {
+class JobSystem;
+struct ImagePayload;
+
+// Streams textures within a GPU memory budget. Textures are loaded and
+// decoded asynchronously (by _jobs if not nullptr), a limited number at once
+// to bound decoded memory. Their smallest mips are uploaded first, then
+// refined by as many levels as the per frame upload budget allows. When the
+// budget is exceeded, least recently used textures are evicted, and loaded
+// again once they are used. Replaced images count against the budget until
+// they are destroyed.
+// Until a texture is resident, its image isn't loaded, and ImDraw renders a
+// placeholder instead.
+class TextureStreamer {
+ public:
+  TextureStreamer(JobSystem* _jobs, size_t _budget,
+                  size_t _upload_budget = kDefaultUploadBudget);
+  ~TextureStreamer();
+
+  TextureStreamer(const TextureStreamer&) = delete;
+  TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+  // Handle to a streamed texture. Id encodes entry slot and version, so
+  // handles of released textures aren't found anymore.
+  struct Texture {
+    uint32_t id = 0;
+  };
+
+  // Starts streaming _filename, see SgAsyncImage for supported formats.
+  Texture Load(const char* _filename);
+  void Release(Texture _texture);
+
+  // Returns _texture image to render with, and marks it as used this frame.
+  // Until it's resident, returned image is never loaded.
+  sg_image Use(Texture _texture);
+
+  // Uploads decoded levels, and evicts textures as needed. Must be called
+  // once per frame from the main thread.
+  void Update();
+
+  struct Stats {
+    int textures;   // Number of textures
+    int resident;   // Textures with at least a level resident
+    int complete;   // Textures with all levels resident
+    size_t bytes;   // GPU memory used by resident levels
+    size_t budget;  // GPU memory budget
+    int evictions;  // Total number of evictions
+  };
+  Stats stats() const;
+
+ private:
+  struct Entry;
+
+  // Queues _entry to be fetched and decoded.
+  void Stream(Entry& _entry);
+
+  // Fetches and decodes _entry file.
+  void Fetch(Entry& _entry);
+
+  // Uploads the next levels of _entry, within _upload bytes but at least one
+  // level. Returns the number of bytes uploaded, 0 if budget doesn't allow
+  // it.
+  size_t Refine(Entry& _entry, size_t _upload);
+
+  // Releases _entry levels and decoded data.
+  void Evict(Entry& _entry);
+
+  Entry* Find(Texture _texture);
+
+  JobSystem* jobs_;
+  size_t budget_;
+  size_t upload_budget_;
+
+  std::vector<std::unique_ptr<Entry>> entries_;
+
+  // Allocated but never loaded image, used for textures that aren't
+  // resident.
+  SgImage pending_;
+
+  // Images replaced during last update, destroyed on the next one as they
+  // can still be referenced by ImDraw batches, and their size.
+  std::vector<SgImage> retired_;
+  size_t retired_bytes_ = 0;
+
+  // Decoded payloads, pushed by decoding jobs.
+  struct Decoded {
+    uint32_t slot;
+    uint32_t generation;
+    std::unique_ptr<ImagePayload> payload;  // nullptr if decoding failed.
+  };
+  std::mutex mutex_;
+  std::vector<Decoded> decoded_;
+  std::atomic<int> decoding_ = 0;
+
+  size_t bytes_ = 0;
+  int evictions_ = 0;
+  uint64_t frame_ = 0;
+};
+
+}  // namespace flip
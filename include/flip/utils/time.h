@@ -12,6 +12,12 @@ class TimeControl {
  public:
   Time Update(float _dt);
 
+  // Fixes update rate to _rate, instead of real time.
+  void FixRate(float _rate) {
+    fixed_rate_ = _rate;
+    fix_rate_ = true;
+  }
+
   bool Gui();
 
  private:
@@ -1,33 +1,84 @@
 #include <cmath>
 
 #include "flip/application.h"
+#include "flip/command_buffer.h"
 #include "flip/imdraw.h"
+#include "flip/utils/jobs.h"
 #include "flip/utils/time.h"
 
-// Implement the minimal flip::Application.
+// ImDraw modes used by the sample, declared up front so their pipelines are
+// built at initialization.
+const flip::ImMode kLineMode = {.type = SG_PRIMITIVETYPE_LINE_STRIP,
+                                .format = flip::ImFormat::kPacked};
+const flip::ImMode kQuadMode = {.type = SG_PRIMITIVETYPE_TRIANGLE_STRIP,
+                                .cull_mode = SG_CULLMODE_NONE,
+                                .alpha_blending = true};
+const flip::ImMode kPointMode = {.type = SG_PRIMITIVETYPE_POINTS,
+                                 .format = flip::ImFormat::kPacked};
+const flip::ImMode kModes[] = {kLineMode, kQuadMode, kPointMode};
+
+// Number of lines recorded from jobs.
+const int kSpokes = 64;
+
+// Implement the minimal flip::Application. It's pipelined, Update computes
+// transforms and records commands one frame ahead, while Display renders the
+// published ones.
 class ImDraw : public flip::Application {
  public:
-  ImDraw() : flip::Application(Settings{.title = "ImDraw"}) {}
+  ImDraw()
+      : flip::Application(Settings{
+            .title = "ImDraw",
+            .im_modes = kModes,
+            .batch_imdraw = true,
+            .pipelined = true}) {}
 
  private:
   virtual LoopControl Update(const flip::Time& _time) override {
     auto elapsed = _time.elapsed;
-    transform1_ = HMM_Rotate_RH(elapsed, HMM_Vec3{0, 1, 0}) *
+    auto& transforms = updated_;
+    transforms.transform1 = HMM_Rotate_RH(elapsed, HMM_Vec3{0, 1, 0}) *
                   HMM_Translate(HMM_Vec3{0, 6, 0}) *
                   HMM_Rotate_RH(HMM_PI / 4, HMM_Vec3{std::cos(elapsed),
                                                      std::sin(elapsed), 0}) *
                   HMM_Scale(HMM_Vec3{3, 3, 3});
-    transform2_ = transform1_ * HMM_Rotate_RH(elapsed, HMM_Vec3{0, 1, 0});
+    transforms.transform2 =
+        transforms.transform1 * HMM_Rotate_RH(elapsed, HMM_Vec3{0, 1, 0});
+
+    // Records spokes from jobs. Keys are spoke indices, so rendering order
+    // doesn't depend on which thread recorded them.
+    auto& commands = *update_commands_;
+    commands.Clear();
+    jobs().ParallelFor(kSpokes, 8, [&](size_t _begin, size_t _end) {
+      auto& buffer = commands.buffer();
+      for (size_t i = _begin; i < _end; ++i) {
+        buffer.key(static_cast<uint32_t>(i));
+        const float angle = flip::k2Pi * i / kSpokes;
+        const auto transform = HMM_Rotate_RH(angle, flip::kUnitY);
+        auto drawer = flip::ImDraw{buffer, transform, kLineMode};
+        drawer.color(flip::kCyan);
+        drawer.vertex(2, 0, 0);
+        drawer.vertex(3 + std::sin(elapsed * 2 + angle * 3), 0, 0);
+      }
+    });
 
     return LoopControl::kContinue;
   }
 
+  virtual void Publish() override {
+    published_ = updated_;
+    std::swap(update_commands_, display_commands_);
+  }
+
   virtual bool Display(flip::Renderer& _renderer) override {
+    // Spokes recorded by Update
+    _renderer.Submit(*display_commands_);
+
     // Green quad contour
     {
-      auto drawer = flip::ImDraw{
-          _renderer, transform2_, {.type = SG_PRIMITIVETYPE_LINE_STRIP}};
+      auto drawer =
+          flip::ImDraw{_renderer, published_.transform2, kLineMode};
 
+      drawer.reserve(5);
       drawer.color(flip::kGreen);
 
       drawer.vertex(-1, -1, 0);
@@ -39,11 +90,8 @@ class ImDraw : public flip::Application {
 
     // Double face alpha blended white quad
     {
-      auto drawer = flip::ImDraw{_renderer,
-                                 transform1_,
-                                 {.type = SG_PRIMITIVETYPE_TRIANGLE_STRIP,
-                                  .cull_mode = SG_CULLMODE_NONE,
-                                  .alpha_blending = true}};
+      auto drawer =
+          flip::ImDraw{_renderer, published_.transform1, kQuadMode};
 
       drawer.color(flip::kYellow, .7f);
 
@@ -55,8 +103,8 @@ class ImDraw : public flip::Application {
 
     // Red axis points
     {
-      auto drawer = flip::ImDraw{
-          _renderer, transform1_, {.type = SG_PRIMITIVETYPE_POINTS}};
+      auto drawer =
+          flip::ImDraw{_renderer, published_.transform1, kPointMode};
 
       drawer.color(flip::kRed);
       drawer.size(10.f);
@@ -68,8 +116,16 @@ class ImDraw : public flip::Application {
     return true;
   }
 
-  HMM_Mat4 transform1_;
-  HMM_Mat4 transform2_;
+  struct Transforms {
+    HMM_Mat4 transform1 = flip::kIdentity4;
+    HMM_Mat4 transform2 = flip::kIdentity4;
+  };
+  Transforms updated_;    // Written by Update
+  Transforms published_;  // Read by Display
+
+  flip::CommandList commands_[2];
+  flip::CommandList* update_commands_ = &commands_[0];
+  flip::CommandList* display_commands_ = &commands_[1];
 };
 
 // Application instantiation function
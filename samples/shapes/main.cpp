@@ -1,3 +1,4 @@
+#include <cmath>
 #include <cstring>
 #include <memory>
 #include <vector>
@@ -5,21 +6,32 @@
 #include "flip/application.h"
 #include "flip/math.h"
 #include "flip/renderer.h"
+#include "flip/utils/jobs.h"
+#include "flip/utils/profile.h"
 #include "imgui/imgui.h"
 #include "logo.h"
 
 // Uses draw and imgui features
 class Shapes : public flip::Application {
  public:
-  Shapes() : flip::Application(Settings{.title = "Shapes"}) {
+  Shapes() : flip::Application(Settings{.title = "Shapes"}) {}
+
+ private:
+  virtual bool Initialize(bool _headless) override {
     ComputeTransforms();
+    return true;
   }
 
- private:
   // Decompresses RLE logo into an array of transforms, where each transform
   // maps a pixel.
   void ComputeTransforms() {
+    FLIP_PROFILE("ComputeTransforms");
     transforms_.clear();
+    retained_dirty_ = true;
+    affines_.clear();
+    translation_scales_.clear();
+    trss_.clear();
+    colors_.clear();
 
     const float kShapeSize = .1f;
     const float xoffset = -flip::logo::kWidth * kShapeSize / 2.f;
@@ -38,16 +50,59 @@ class Shapes : public flip::Application {
         for (int c = 0; c < count; ++c, pos.X += kShapeSize) {
           transforms_.push_back(HMM_Translate(pos) *
                                 HMM_Scale(scale_ * kShapeSize));
+
+          // Heat map colors, from left to right.
+          const float t = (pos.X - xoffset) / (-2.f * xoffset);
+          colors_.push_back({t, 1.f - std::abs(t * 2.f - 1.f), 1.f - t, 1.f});
         }
       } else {  // Pixels off
         pos.X += kShapeSize * count;
       }
     }
+
+    // Compact transforms alternatives, computed in parallel. Only x scale is
+    // used as translation/scale formats are limited to uniform scales.
+    affines_.resize(transforms_.size());
+    translation_scales_.resize(transforms_.size());
+    trss_.resize(transforms_.size());
+    const float scale = scale_.X * kShapeSize;
+    jobs().ParallelFor(transforms_.size(), 0, [&](size_t _begin, size_t _end) {
+      for (size_t i = _begin; i < _end; ++i) {
+        const auto& m = transforms_[i].Elements;
+        for (int r = 0; r < 3; ++r) {
+          affines_[i].rows[r] = {m[0][r], m[1][r], m[2][r], m[3][r]};
+        }
+        const auto translation = transforms_[i].Columns[3].XYZ;
+        translation_scales_[i] = {translation, scale};
+        trss_[i] = {translation, scale, {0, 0, 0, 1}};
+      }
+    });
   }
 
   // Renders a box per transform
   virtual bool Display(flip::Renderer& _renderer) override {
-    return _renderer.DrawShapes(transforms_, shape_, color_);
+    if (instance_colors_) {
+      return _renderer.DrawShapes(transforms_, colors_, shape_);
+    }
+    switch (format_) {
+      case kAffine:
+        return _renderer.DrawShapes(affines_, shape_, color_);
+      case kTranslationScale:
+        return _renderer.DrawShapes(translation_scales_, shape_, color_);
+      case kTranslationRotationScale:
+        return _renderer.DrawShapes(trss_, shape_, color_);
+      case kRetained:
+        // Transforms are uploaded once, or when they change.
+        if (retained_.id == 0) {
+          retained_ = _renderer.CreateInstances(transforms_);
+        } else if (retained_dirty_) {
+          _renderer.UpdateInstances(retained_, 0, transforms_);
+        }
+        retained_dirty_ = false;
+        return _renderer.DrawShapes(retained_, shape_, color_);
+      default:
+        return _renderer.DrawShapes(transforms_, shape_, color_);
+    }
   }
 
   virtual bool Menu() override {
@@ -64,7 +119,13 @@ class Shapes : public flip::Application {
                    "Plane\0Cube\0Sphere\0Cylinder\0Torus\0");
       shape_ = static_cast<flip::Renderer::Shape>(shape);
 
-      ImGui::ColorPicker3("Shape color", color_.rgba);
+      ImGui::Checkbox("Colors per instance", &instance_colors_);
+      if (!instance_colors_) {
+        ImGui::Combo("Transform format", &format_,
+                     "Matrix\0Affine\0Translation scale\0Translation "
+                     "rotation scale\0Retained matrix\0");
+        ImGui::ColorPicker3("Shape color", color_.rgba);
+      }
 
       ImGui::EndMenu();
     }
@@ -73,9 +134,28 @@ class Shapes : public flip::Application {
   }
 
   std::vector<HMM_Mat4> transforms_;
+  std::vector<flip::Affine> affines_;
+  std::vector<flip::TranslationScale> translation_scales_;
+  std::vector<flip::TranslationRotationScale> trss_;
+  std::vector<flip::Color> colors_;
   flip::Renderer::Shape shape_ = flip::Renderer::Shape::kSphere;
   HMM_Vec3 scale_ = {.8f, .8f, .8f};
   flip::Color color_ = flip::kWhite;
+  bool instance_colors_ = false;
+
+  // Instance transforms format.
+  enum Format {
+    kMatrix,
+    kAffine,
+    kTranslationScale,
+    kTranslationRotationScale,
+    kRetained
+  };
+  int format_ = kMatrix;
+
+  // Retained instances, updated when transforms change.
+  flip::Renderer::Instances retained_;
+  bool retained_dirty_ = true;
 };
 
 std::unique_ptr<flip::Application> InstantiateApplication() {
@@ -2,6 +2,7 @@
 #include "flip/imdraw.h"
 #include "flip/utils/loader.h"
 #include "flip/utils/sokol_gfx.h"
+#include "flip/utils/texture_streamer.h"
 #include "imgui/imgui.h"
 
 // Implement the minimal flip::Application.
@@ -18,10 +19,27 @@ class Texture : public flip::Application {
     image_ = flip::SgAsyncImage("media/texture.png");
     sampler_ = SetupSampler(linear_);
 
+    // Same texture, streamed progressively.
+    streamer_ = std::make_unique<flip::TextureStreamer>(&jobs(), 32 << 20);
+    streamed_ = streamer_->Load("media/texture.png");
+
     return true;
   }
 
   virtual bool Display(flip::Renderer& _renderer) override {
+    streamer_->Update();
+    {
+      auto drawer = flip::ImDraw{_renderer,
+                                 flip::kIdentity4,
+                                 {.type = SG_PRIMITIVETYPE_TRIANGLE_STRIP,
+                                  .cull_mode = SG_CULLMODE_NONE}};
+      drawer.texture(streamer_->Use(streamed_), sampler_.id());
+      drawer.vertex(6, 10, 0, 0, 0);
+      drawer.vertex(6, 0, 0, 0, 1);
+      drawer.vertex(16, 10, 0, 1, 0);
+      drawer.vertex(16, 0, 0, 1, 1);
+    }
+
     auto drawer = flip::ImDraw{_renderer,
                                flip::kIdentity4,
                                {.type = SG_PRIMITIVETYPE_TRIANGLE_STRIP,
@@ -46,8 +64,10 @@ class Texture : public flip::Application {
 
   static flip::SgSampler SetupSampler(bool _linear) {
     auto filter = _linear ? SG_FILTER_LINEAR : SG_FILTER_NEAREST;
-    return flip::MakeSgSampler(sg_sampler_desc{
-        .min_filter = filter, .mag_filter = filter, .label = "Texture sample"});
+    return flip::MakeSgSampler(sg_sampler_desc{.min_filter = filter,
+                                               .mag_filter = filter,
+                                               .mipmap_filter = filter,
+                                               .label = "Texture sample"});
   }
 
   virtual bool Menu() override {
@@ -60,6 +80,10 @@ class Texture : public flip::Application {
       ImGui::Checkbox("Enable alpha test", &alpha_test_);
       ImGui::Checkbox("Enable alpha to coverage", &alpha_to_coverage_);
       ImGui::ColorEdit4("Color", color_.rgba);
+      const auto stats = streamer_->stats();
+      ImGui::LabelText("Streaming", "%d/%d resident, %zu/%zu KB",
+                       stats.resident, stats.textures, stats.bytes >> 10,
+                       stats.budget >> 10);
       ImGui::EndMenu();
     }
 
@@ -70,6 +94,9 @@ class Texture : public flip::Application {
   flip::SgAsyncImage image_;
   flip::SgSampler sampler_;
 
+  std::unique_ptr<flip::TextureStreamer> streamer_;
+  flip::TextureStreamer::Texture streamed_;
+
   flip::Color color_ = flip::kYellow;
   bool texture_ = true;
   bool linear_ = true;
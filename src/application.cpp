@@ -1,15 +1,22 @@
 #include "flip/application.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
 #include <cstdlib>
 #include <filesystem>
 #include <memory>
+#include <string>
 
 #include "flip/camera.h"
 #include "flip/renderer.h"
+#include "flip/utils/jobs.h"
+#include "flip/utils/loader.h"
 #include "flip/utils/profile.h"
 #include "flip/utils/time.h"
+#include "impl/benchmark.h"
 #include "impl/factory.h"
+#include "impl/trace_capture.h"
 
 // Sokol library
 #include "sokol/sokol_app.h"
@@ -33,18 +40,57 @@ class ApplicationCb {
     if (sargs_exists("headless")) {
       headless_ = sargs_boolean("headless");
     }
+
+    // Number of frames run headless, or recorded by benchmark.
+    const bool benchmark = sargs_exists("benchmark");
+    frames_ = std::atoi(sargs_value_def("frames", benchmark ? "600" : "10"));
+    valid_ &= frames_ > 0;
+
+    // Benchmark mode records frames timings to the "benchmark" file, with a
+    // fixed update rate so all runs simulate the same thing. Display is
+    // benchmarked too, which requires a gfx context, so it's never headless.
+    if (benchmark) {
+      const int warmup = std::atoi(sargs_value_def("warmup", "60"));
+      valid_ &= warmup >= 0;
+      if (valid_) {
+        benchmark_ = std::make_unique<Benchmark>(sargs_value("benchmark"),
+                                                 frames_, warmup);
+      }
+      time_control_.FixRate(60.f);
+      headless_ = false;
+    }
+
+    // Captures a trace of the first frames to the "trace" file.
+    if (sargs_exists("trace")) {
+      const int trace_frames =
+          std::atoi(sargs_value_def("trace_frames", "60"));
+      valid_ &= trace_frames > 0;
+      if (valid_) {
+        trace_ =
+            std::make_unique<TraceCapture>(sargs_value("trace"), trace_frames);
+      }
+    }
   }
   ~ApplicationCb() = default;
 
   static int Run(int _argc, char* _argv[]) {
     // Setup sargs (cli arguments) so application can use it
     sargs_setup(sargs_desc{.argc = _argc, .argv = _argv});
+    set_thread_profile_name("Main");
 
     auto app_cb = std::make_unique<ApplicationCb>();
+    if (!app_cb->valid_) {
+      std::fprintf(stderr,
+                   "Invalid \"frames\", \"warmup\" or \"trace_frames\" "
+                   "argument.\n");
+      app_cb = nullptr;
+      sargs_shutdown();
+      return EXIT_FAILURE;
+    }
     if (app_cb->headless_) {
-      // Implement a basic headless loop
+      // Implement a basic headless loop.
       app_cb->Init();
-      for (size_t i = 0; i < 10 && !app_cb->exit_; ++i) {
+      for (int i = 0; i < app_cb->frames_ && !app_cb->exit_; ++i) {
         app_cb->Frame();
       }
       app_cb.release()->Cleanup();
@@ -89,14 +135,37 @@ class ApplicationCb {
     // Time management
     stm_setup();
 
-    // Fetching
+    // Fetching, "fetch_channels" and "fetch_lanes" arguments allow to tune
+    // concurrency: channels are IO threads on native platforms, and each
+    // channel handles as many requests as lanes in parallel. Arguments are
+    // clamped to sokol_fetch limits.
+    auto fetch_arg = [](const char* _name, const char* _default, int _max) {
+      return static_cast<uint32_t>(
+          std::clamp(std::atoi(sargs_value_def(_name, _default)), 1, _max));
+    };
     const auto& app_desc = sapp_query_desc();
-    sfetch_setup(
-        sfetch_desc_t{.logger = {.func = app_desc.logger.func,
-                                 .user_data = app_desc.logger.user_data}});
+    sfetch_setup(sfetch_desc_t{
+        .max_requests = fetch_arg("fetch_requests", "1024", 0xfffe),
+        .num_channels = fetch_arg("fetch_channels", "2", SFETCH_MAX_CHANNELS),
+        .num_lanes = fetch_arg("fetch_lanes", "8", 256),
+        .logger = {.func = app_desc.logger.func,
+                   .user_data = app_desc.logger.user_data}});
+
+    // Jobs, "workers" argument allows to override workers count.
+    jobs_ = std::make_unique<JobSystem>(
+        std::atoi(sargs_value_def("workers", "-1")));
+    application_->jobs_ = jobs_.get();
+
+    // Images are decoded by jobs, "image_cache" argument allows to cache
+    // decoded images to a directory.
+    SetupAsyncImages(jobs_.get(), kDefaultUploadBudget,
+                     sargs_value_def("image_cache", ""));
 
     if (!headless_) {
-      renderer_ = Factory().InstantiateRenderer();
+      // Benchmark renders offscreen, independently of the window.
+      renderer_ = Factory().InstantiateRenderer(benchmark_ != nullptr);
+      renderer_->WarmUpImModes(application_->settings().im_modes);
+      renderer_->BatchImDraw(application_->settings().batch_imdraw);
       camera_ = Factory().InstantiateCamera();
     }
 
@@ -108,10 +177,17 @@ class ApplicationCb {
   }
 
   void Cleanup() {
+    // Pipelined update can't outlive application.
+    if (jobs_) {
+      jobs_->Wait(update_pending_);
+    }
+
     // Release resources (symmetrical to constructor & initialize)
     application_ = nullptr;
+    ShutdownAsyncImages();
     camera_ = nullptr;
     renderer_ = nullptr;
+    jobs_ = nullptr;
 
     // Stops fetching
     sfetch_shutdown();
@@ -132,18 +208,83 @@ class ApplicationCb {
   }
 
   void Frame() {
+    // Frame boundary, taken before any profiling scope, so last frame scopes
+    // are all nested in [last_time_, now].
+    const uint64_t now = stm_now();
     bool success = true;
     bool exit = false;
 
-    // Ticks fetching
+    // Aggregates and captures scopes of the last frame, from all threads.
+    collect_profile_events(profile_threads_);
+    profile_tree_.Aggregate(profile_threads_);
+    if (trace_ && last_time_ != 0 &&
+        trace_->Record(profile_threads_, last_time_, now)) {
+      trace_status_ = (trace_->Write() ? "Written to " : "Failed to write ") +
+                      trace_->path();
+      trace_ = nullptr;
+    }
+
+    // Ticks fetching, and uploads images decoded meanwhile.
     sfetch_dowork();
+    if (!headless_) {
+      FLIP_PROFILE("Upload images");
+      UploadAsyncImages();
+    }
 
     // Updates time.
-    const auto sys_dt = static_cast<float>(stm_sec(stm_laptime(&last_time_)));
+    const auto sys_dt = static_cast<float>(
+        last_time_ != 0 ? stm_sec(stm_diff(now, last_time_)) : 0.);
+    last_time_ = now;
     profile_frame_.push(sys_dt * 1e3f);
+    frame_histogram_.push(sys_dt * 1e3f);
+
+    // Waits for the pipelined update started last frame and publishes its
+    // results, so its duration is recorded with the frame that started it.
+    if (update_started_) {
+      {
+        FLIP_PROFILE("Update wait");
+        jobs_->Wait(update_pending_);
+      }
+      update_started_ = false;
+      profile_update_.push(update_ms_);
+      success &= update_control_ != Application::LoopControl::kBreakFailure;
+      exit = update_control_ != Application::LoopControl::kContinue;
+      application_->Publish();
+    }
+
+    // Records last frame timings, as frame time is only known now.
+    if (benchmark_ && !exit_ && frame_++ > 0) {
+      const int late_pipelines =
+          renderer_ ? renderer_->GetLatePipelines() : 0;
+      const int frame_late_pipelines = late_pipelines - late_pipelines_;
+      late_pipelines_ = late_pipelines;
+      if (benchmark_->Record({.update = profile_update_.front(),
+                              .render = profile_render_.front(),
+                              .frame = profile_frame_.front(),
+                              .late_pipelines = frame_late_pipelines})) {
+        RequestExit(benchmark_->Write());
+        return;
+      }
+    }
+
     const auto time = time_control_.Update(sys_dt);
 
-    {  // Updates application
+    if (application_->settings().pipelined) {
+      // Starts next update, which runs while this frame is rendered. No
+      // further update is started once exiting.
+      update_started_ = !exit && success && !exit_;
+      if (update_started_) {
+        jobs_->Submit(
+            [this, time]() {
+              FLIP_PROFILE("Update");
+              const auto start = stm_now();
+              update_control_ = application_->Update(time);
+              update_ms_ = static_cast<float>(stm_ms(stm_since(start)));
+            },
+            update_pending_);
+      }
+    } else {  // Updates application
+      FLIP_PROFILE("Update");
       Profile profile(profile_update_);
       const auto control = application_->Update(time);
       success &= control != Application::LoopControl::kBreakFailure;
@@ -152,6 +293,7 @@ class ApplicationCb {
 
     // Renders application
     if (!headless_) {
+      FLIP_PROFILE("Render");
       Profile profile(profile_render_);
       success &= Display(time);
     }
@@ -192,16 +334,6 @@ class ApplicationCb {
 
   bool Menu() {
     auto plot_all = [this]() {
-      auto plot = [](const char* _label, const auto& _rec) {
-        auto [data, offset] = _rec.view();
-        auto [min, mean, max] = stats(data);
-        char overlay[64];
-        std::snprintf(overlay, sizeof(overlay),
-                      "Min %.2g ms\nMean %.2g ms\nMax %.2g ms", min, mean, max);
-        ImGui::PlotLines(_label, data.data(), data.size(), offset, overlay, min,
-                         max, ImVec2{0, 80});
-      };
-
       ImGui::LabelText("Frame rate", "%.0f fps", 1000 / profile_frame_.front());
       plot("Update", profile_update_);
       plot("Render", profile_render_);
@@ -217,6 +349,25 @@ class ApplicationCb {
         plot_all();
         ImGui::TreePop();
       }
+      if (ImGui::TreeNodeEx("Distribution")) {
+        frame_histogram_.Gui("Frame");
+        ImGui::TreePop();
+      }
+      if (ImGui::TreeNodeEx("Scopes")) {
+        profile_tree_.Gui(profile_frame_.front());
+        ImGui::TreePop();
+      }
+      if (ImGui::TreeNodeEx("Trace capture")) {
+        ImGui::SliderInt("Frames", &trace_frames_, 1, 600);
+        if (trace_) {
+          ImGui::TextUnformatted("Capturing...");
+        } else if (ImGui::Button("Capture")) {
+          trace_ = std::make_unique<TraceCapture>("flip_trace.json",
+                                                  trace_frames_);
+        }
+        ImGui::TextUnformatted(trace_status_.c_str());
+        ImGui::TreePop();
+      }
       ImGui::EndMenu();
     }
     return true;
@@ -231,6 +382,7 @@ class ApplicationCb {
 
  private:
   // Resources, order is important for destruction order
+  std::unique_ptr<JobSystem> jobs_;
   std::unique_ptr<Renderer> renderer_;
   std::unique_ptr<Camera> camera_;
   std::unique_ptr<Application> application_;
@@ -239,6 +391,22 @@ class ApplicationCb {
   ProfileRecord profile_update_;
   ProfileRecord profile_render_;
   ProfileRecord profile_frame_;
+  ProfileHistogram frame_histogram_;
+  ProfileTree profile_tree_;
+  std::vector<ProfileThread> profile_threads_;
+
+  // Trace capture, while capturing.
+  std::unique_ptr<TraceCapture> trace_;
+  int trace_frames_ = 60;
+  std::string trace_status_;
+
+  // Pipelined update, written by the update job and read by the main thread
+  // once update_pending_ reaches 0.
+  JobSystem::Counter update_pending_ = 0;
+  Application::LoopControl update_control_ =
+      Application::LoopControl::kContinue;
+  float update_ms_ = 0;
+  bool update_started_ = false;
 
   // Time management
   TimeControl time_control_;
@@ -247,6 +415,15 @@ class ApplicationCb {
   // Does application has a windows (head)
   bool headless_ = false;
 
+  // Number of headless frames, and validity of command line arguments.
+  int frames_ = 0;
+  bool valid_ = true;
+
+  // Benchmark mode, when enabled.
+  std::unique_ptr<Benchmark> benchmark_;
+  int frame_ = 0;
+  int late_pipelines_ = 0;
+
   // Exit management.
   bool exit_ = false;
   static int exit_code_;
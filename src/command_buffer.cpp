@@ -0,0 +1,146 @@
+#include "flip/command_buffer.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace flip {
+
+void CommandBuffer::DrawShapes(std::span<const HMM_Mat4> _transforms,
+                               Renderer::Shape _shape, Color _color) {
+  if (_transforms.empty()) {
+    return;
+  }
+  commands_.push_back(
+      {.type = Command::kShapes,
+       .key = key_,
+       .first = static_cast<uint32_t>(transforms_.size()),
+       .count = static_cast<uint32_t>(_transforms.size()),
+       .shape = _shape,
+       .color = _color,
+       .colors = ~uint32_t{0}});
+  transforms_.insert(transforms_.end(), _transforms.begin(), _transforms.end());
+}
+
+void CommandBuffer::DrawShapes(std::span<const HMM_Mat4> _transforms,
+                               std::span<const Color> _colors,
+                               Renderer::Shape _shape) {
+  assert(_transforms.size() == _colors.size());
+  const auto count = std::min(_transforms.size(), _colors.size());
+  if (count == 0) {
+    return;
+  }
+  commands_.push_back(
+      {.type = Command::kShapes,
+       .key = key_,
+       .first = static_cast<uint32_t>(transforms_.size()),
+       .count = static_cast<uint32_t>(count),
+       .shape = _shape,
+       .color = kWhite,
+       .colors = static_cast<uint32_t>(colors_.size())});
+  transforms_.insert(transforms_.end(), _transforms.begin(),
+                     _transforms.begin() + count);
+  colors_.insert(colors_.end(), _colors.begin(), _colors.begin() + count);
+}
+
+void CommandBuffer::Clear() {
+  assert(scope_ == kNoScope && "Can't clear while recording an ImDraw scope.");
+  commands_.clear();
+  vertices_.clear();
+  transforms_.clear();
+  colors_.clear();
+  key_ = 0;
+}
+
+void CommandBuffer::BeginImDraw(const HMM_Mat4& _transform,
+                                const ImMode& _mode) {
+  assert(scope_ == kNoScope && "ImDraw scopes can't be nested.");
+  scope_ = commands_.size();
+  commands_.push_back({.type = Command::kImDraw,
+                       .key = key_,
+                       .first = static_cast<uint32_t>(vertices_.size()),
+                       .count = 0,
+                       .transform = _transform,
+                       .mode = _mode});
+}
+
+std::span<ImVertex> CommandBuffer::ReallocateImVertices(
+    std::span<ImVertex> _vertices, size_t _count) {
+  // Scope vertices are always the last ones, so they're resized in place.
+  assert(scope_ != kNoScope);
+  const auto first = commands_[scope_].first;
+  assert(_vertices.empty() || _vertices.data() == vertices_.data() + first);
+  vertices_.resize(first + _count);
+  return {vertices_.data() + first, _count};
+}
+
+void CommandBuffer::EndImDraw(std::span<const ImVertex> _vertices,
+                              sg_image _image, sg_sampler _sampler) {
+  assert(scope_ != kNoScope);
+  auto& command = commands_[scope_];
+  scope_ = kNoScope;
+  command.count = static_cast<uint32_t>(_vertices.size());
+  command.image = _image;
+  command.sampler = _sampler;
+}
+
+CommandBuffer& CommandList::buffer() {
+  const auto thread = std::this_thread::get_id();
+  std::lock_guard lock(mutex_);
+  auto it = std::find_if(buffers_.begin(), buffers_.end(),
+                         [thread](auto& _e) { return _e.thread == thread; });
+  if (it == buffers_.end()) {
+    it = buffers_.insert(buffers_.end(),
+                         {thread, std::make_unique<CommandBuffer>()});
+  }
+  return *it->buffer;
+}
+
+void CommandList::Clear() {
+  for (auto& entry : buffers_) {
+    entry.buffer->Clear();
+  }
+}
+
+bool CommandList::Replay(Renderer& _renderer) const {
+  // Merges all buffers commands. Sorting by (key, buffer, index) is a total
+  // order, so it's stable.
+  order_.clear();
+  for (size_t b = 0; b < buffers_.size(); ++b) {
+    const auto count = buffers_[b].buffer->commands_.size();
+    for (size_t c = 0; c < count; ++c) {
+      order_.emplace_back(static_cast<uint32_t>(b), static_cast<uint32_t>(c));
+    }
+  }
+  auto command = [this](std::pair<uint32_t, uint32_t> _index) -> auto& {
+    return buffers_[_index.first].buffer->commands_[_index.second];
+  };
+  std::sort(order_.begin(), order_.end(), [&command](auto _a, auto _b) {
+    const auto ka = command(_a).key, kb = command(_b).key;
+    return ka != kb ? ka < kb : _a < _b;
+  });
+
+  bool success = true;
+  auto& target = static_cast<ImDrawTarget&>(_renderer);
+  for (const auto& index : order_) {
+    const auto& buffer = *buffers_[index.first].buffer;
+    const auto& cmd = command(index);
+    if (cmd.type == CommandBuffer::Command::kImDraw) {
+      target.BeginImDraw(cmd.transform, cmd.mode);
+      target.EndImDraw({buffer.vertices_.data() + cmd.first, cmd.count},
+                       cmd.image, cmd.sampler);
+    } else {
+      const auto transforms =
+          std::span{buffer.transforms_}.subspan(cmd.first, cmd.count);
+      if (cmd.colors == ~uint32_t{0}) {
+        success &= _renderer.DrawShapes(transforms, cmd.shape, cmd.color);
+      } else {
+        const auto colors =
+            std::span{buffer.colors_}.subspan(cmd.colors, cmd.count);
+        success &= _renderer.DrawShapes(transforms, colors, cmd.shape);
+      }
+    }
+  }
+  return success;
+}
+
+}  // namespace flip
@@ -0,0 +1,105 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cassert>
+#include <filesystem>
+
+#include "flip/utils/profile.h"
+
+namespace flip {
+
+namespace {
+// Timings names and accessors, in output order.
+struct Timing {
+  const char* name;
+  float Benchmark::Sample::*value;
+};
+const Timing kTimings[] = {{"update", &Benchmark::Sample::update},
+                           {"render", &Benchmark::Sample::render},
+                           {"frame", &Benchmark::Sample::frame}};
+}  // namespace
+
+Benchmark::Benchmark(const char* _path, int _frames, int _warmup)
+    : path_{_path}, frames_{_frames}, warmup_{_warmup} {
+  assert(_frames > 0 && _warmup >= 0);
+  samples_.reserve(_frames);
+}
+
+bool Benchmark::Record(const Sample& _sample) {
+  if (warmup_ > 0) {
+    --warmup_;
+    return false;
+  }
+  if (static_cast<int>(samples_.size()) < frames_) {
+    samples_.push_back(_sample);
+  }
+  return static_cast<int>(samples_.size()) == frames_;
+}
+
+bool Benchmark::Write() const {
+  std::FILE* file = std::fopen(path_.c_str(), "w");
+  if (!file) {
+    return false;
+  }
+  const bool json = std::filesystem::path(path_).extension() == ".json";
+  bool success = json ? WriteJson(file) : WriteCsv(file);
+  success &= std::fclose(file) == 0;
+  return success;
+}
+
+bool Benchmark::WriteJson(std::FILE* _file) const {
+  int late_pipelines = 0;
+  for (const auto& sample : samples_) {
+    late_pipelines += sample.late_pipelines;
+  }
+  std::fprintf(_file,
+               "{\n  \"frames\": %zu,\n  \"budget\": %g,\n"
+               "  \"late_pipelines\": %d,\n  \"summary\": {\n",
+               samples_.size(), ProfileHistogram::kDefaultBudget,
+               late_pipelines);
+  std::vector<float> values(samples_.size());
+  for (const auto& timing : kTimings) {
+    for (size_t i = 0; i < samples_.size(); ++i) {
+      values[i] = samples_[i].*timing.value;
+    }
+    const auto [min, mean, max] =
+        values.empty() ? ProfileStats{} : stats(values);
+
+    // Percentiles and hitches over all samples.
+    auto histogram = ProfileHistogram(std::max<int>(values.size(), 1));
+    for (const float value : values) {
+      histogram.push(value);
+    }
+    std::fprintf(_file,
+                 "    \"%s\": {\"min\": %g, \"mean\": %g, \"max\": %g, "
+                 "\"p50\": %g, \"p90\": %g, \"p99\": %g, \"p99.9\": %g, "
+                 "\"hitches\": %d}%s\n",
+                 timing.name, min, mean, max, histogram.percentile(.5f),
+                 histogram.percentile(.9f), histogram.percentile(.99f),
+                 histogram.percentile(.999f), histogram.hitches(),
+                 &timing == std::end(kTimings) - 1 ? "" : ",");
+  }
+  std::fprintf(_file, "  },\n  \"samples\": [\n");
+  for (size_t i = 0; i < samples_.size(); ++i) {
+    const auto& sample = samples_[i];
+    std::fprintf(_file,
+                 "    {\"update\": %g, \"render\": %g, \"frame\": %g, "
+                 "\"late_pipelines\": %d}%s\n",
+                 sample.update, sample.render, sample.frame,
+                 sample.late_pipelines, i + 1 == samples_.size() ? "" : ",");
+  }
+  std::fprintf(_file, "  ]\n}\n");
+  return !std::ferror(_file);
+}
+
+bool Benchmark::WriteCsv(std::FILE* _file) const {
+  std::fprintf(_file, "frame,update_ms,render_ms,frame_ms,late_pipelines\n");
+  for (size_t i = 0; i < samples_.size(); ++i) {
+    const auto& sample = samples_[i];
+    std::fprintf(_file, "%zu,%g,%g,%g,%d\n", i, sample.update, sample.render,
+                 sample.frame, sample.late_pipelines);
+  }
+  return !std::ferror(_file);
+}
+
+}  // namespace flip
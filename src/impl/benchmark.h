@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace flip {
+
+// Records per frame timings over a number of frames, excluding warm-up frames,
+// and writes them to a file for offline analysis.
+class Benchmark {
+ public:
+  Benchmark(const char* _path, int _frames, int _warmup);
+
+  // Timings of a frame, in ms, and number of pipelines created late during
+  // the frame.
+  struct Sample {
+    float update;
+    float render;
+    float frame;
+    int late_pipelines;
+  };
+
+  // Returns true once all frames were recorded.
+  bool Record(const Sample& _sample);
+
+  // Writes samples to the file, as json if path extension is ".json", as csv
+  // otherwise.
+  bool Write() const;
+
+ private:
+  bool WriteJson(std::FILE* _file) const;
+  bool WriteCsv(std::FILE* _file) const;
+
+  std::string path_;
+  int frames_;
+  int warmup_;
+  std::vector<Sample> samples_;
+};
+
+}  // namespace flip
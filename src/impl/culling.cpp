@@ -0,0 +1,62 @@
+#include "culling.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace flip {
+
+void Culling::Setup(const HMM_Mat4& _view_proj, float _lod_scale) {
+  // Gribb-Hartmann extraction, from matrix rows.
+  HMM_Vec4 rows[4];
+  for (int r = 0; r < 4; ++r) {
+    rows[r] = {_view_proj.Elements[0][r], _view_proj.Elements[1][r],
+               _view_proj.Elements[2][r], _view_proj.Elements[3][r]};
+  }
+  planes_[0] = rows[3] + rows[0];
+  planes_[1] = rows[3] - rows[0];
+  planes_[2] = rows[3] + rows[1];
+  planes_[3] = rows[3] - rows[1];
+  planes_[4] = rows[2];  // Zero to one clip space depth.
+  planes_[5] = rows[3] - rows[2];
+
+  // Normalizes planes so distances can be compared to radii.
+  for (auto& plane : planes_) {
+    plane = plane * (1.f / HMM_Len(plane.XYZ));
+  }
+
+  depth_ = rows[3];
+  lod_scale_ = _lod_scale;
+}
+
+void Culling::Classify(std::span<const HMM_Vec4> _spheres,
+                       std::span<const float> _lod_sizes,
+                       std::span<int8_t> _lods) const {
+  assert(_spheres.size() == _lods.size());
+
+  // Loops are kept branchless so the compiler can vectorize them.
+  const auto count = _spheres.size();
+  for (size_t i = 0; i < count; ++i) {
+    const auto& sphere = _spheres[i];
+
+    // Sphere is outside if it's entirely behind any plane.
+    bool inside = true;
+    for (const auto& plane : planes_) {
+      const float distance = plane.X * sphere.X + plane.Y * sphere.Y +
+                             plane.Z * sphere.Z + plane.W;
+      inside &= distance > -sphere.W;
+    }
+
+    // Projected radius, ratio of viewport half height.
+    const float depth = depth_.X * sphere.X + depth_.Y * sphere.Y +
+                        depth_.Z * sphere.Z + depth_.W;
+    const float size = sphere.W * lod_scale_ / std::max(depth, 1e-6f);
+    int8_t lod = 0;
+    for (float lod_size : _lod_sizes) {
+      lod += size < lod_size;
+    }
+    _lods[i] = inside ? lod : -1;
+  }
+}
+
+}  // namespace flip
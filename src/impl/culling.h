@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <span>
+
+#include "flip/math.h"
+
+namespace flip {
+
+// Frustum culling and level of detail selection of bounding spheres.
+class Culling {
+ public:
+  // Extracts frustum planes from view-projection matrix. _lod_scale is the
+  // vertical scale factor of the projection, ie 1 / tan(fov / 2).
+  void Setup(const HMM_Mat4& _view_proj, float _lod_scale);
+
+  // Classifies bounding spheres (xyz center, w radius). Outputs each sphere
+  // level of detail to _lods, or -1 if sphere is outside of the frustum.
+  // Level is the number of decreasing _lod_sizes that are greater than the
+  // sphere projected radius, expressed as a ratio of the viewport half height.
+  void Classify(std::span<const HMM_Vec4> _spheres,
+                std::span<const float> _lod_sizes,
+                std::span<int8_t> _lods) const;
+
+ private:
+  // Left, right, bottom, top, near and far planes, pointing inward.
+  HMM_Vec4 planes_[6];
+
+  // Last row of view-projection matrix, computing clip space w (ie view
+  // depth).
+  HMM_Vec4 depth_;
+
+  float lod_scale_ = 1.f;
+};
+
+}  // namespace flip
@@ -8,8 +8,8 @@ namespace flip {
 std::unique_ptr<Camera> Factory::InstantiateCamera() {
   return std::make_unique<OrbitCamera>();
 }
-std::unique_ptr<Renderer> Factory::InstantiateRenderer() {
-  return std::make_unique<RendererImpl>();
+std::unique_ptr<Renderer> Factory::InstantiateRenderer(bool _offscreen) {
+  return std::make_unique<RendererImpl>(_offscreen);
 }
 
 }  // namespace flip
\ No newline at end of file
@@ -8,6 +8,8 @@ class Renderer;
 
 struct Factory {
   std::unique_ptr<Camera> InstantiateCamera();
-  std::unique_ptr<Renderer> InstantiateRenderer();
+  // An _offscreen renderer renders to a render target instead of the default
+  // framebuffer.
+  std::unique_ptr<Renderer> InstantiateRenderer(bool _offscreen = false);
 };
 }  // namespace flip
\ No newline at end of file
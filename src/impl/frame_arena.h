@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace flip {
+
+// Linear allocator of _Ty elements, whose allocations are valid until the next
+// Reset(). Allocating is a bump of a pointer within the current block. Blocks
+// are never moved, so earlier allocations remain valid when the arena grows.
+// Reset() coalesces blocks into a single one, large enough for a whole frame,
+// so allocations stop hitting the heap once a stable size is reached.
+template <typename _Ty>
+class FrameArena {
+ public:
+  explicit FrameArena(size_t _capacity = 0) { AddBlock(_capacity); }
+
+  // Resizes _span, which must have been allocated by this arena, to _count
+  // elements, preserving its content. It's done in place if _span is the last
+  // allocation and current block has enough room, otherwise content is copied
+  // to a new allocation.
+  std::span<_Ty> Reallocate(std::span<_Ty> _span, size_t _count) {
+    auto& block = blocks_.back();
+    if (!_span.empty() && _span.data() == block.data.get() + last_ &&
+        last_ + _count <= block.capacity) {
+      used_ = last_ + _count;
+    } else {
+      if (used_ + _count > block.capacity) {
+        AddBlock(std::max(block.capacity * 2, _count));
+      }
+      last_ = used_;
+      used_ += _count;
+      std::copy_n(_span.data(), std::min(_span.size(), _count),
+                  blocks_.back().data.get() + last_);
+    }
+    peak_ = std::max(peak_, allocated_ + used_);
+    return {blocks_.back().data.get() + last_, _count};
+  }
+
+  // Invalidates all allocations.
+  void Reset() {
+    if (blocks_.size() > 1) {
+      // Makes room for all the memory used since the last reset.
+      blocks_.clear();
+      AddBlock(peak_);
+    }
+    frame_peak_ = peak_;
+    allocated_ = used_ = last_ = peak_ = 0;
+  }
+
+  // Number of elements allocated from the heap.
+  size_t capacity() const { return capacity_; }
+
+  // Maximum number of elements used during the last frame.
+  size_t frame_peak() const { return frame_peak_; }
+
+ private:
+  void AddBlock(size_t _capacity) {
+    if (blocks_.empty()) {
+      capacity_ = 0;
+    } else {
+      allocated_ += used_;
+    }
+    capacity_ += _capacity;
+    blocks_.push_back({std::make_unique<_Ty[]>(_capacity), _capacity});
+    used_ = last_ = 0;
+  }
+
+  struct Block {
+    std::unique_ptr<_Ty[]> data;
+    size_t capacity;
+  };
+  std::vector<Block> blocks_;
+
+  // Elements used in previous blocks, and in the current one.
+  size_t allocated_ = 0;
+  size_t used_ = 0;
+
+  // Offset of the last allocation in the current block.
+  size_t last_ = 0;
+
+  // Maximum number of elements used since last reset, and during last frame.
+  size_t peak_ = 0;
+  size_t frame_peak_ = 0;
+
+  size_t capacity_ = 0;
+};
+
+}  // namespace flip
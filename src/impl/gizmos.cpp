@@ -0,0 +1,188 @@
+#include "gizmos.h"
+
+#include <cstddef>
+
+#include "flip/math.h"
+
+namespace flip {
+
+namespace {
+struct AxesUniforms {
+  HMM_Mat4 vp;
+};
+
+struct GridUniforms {
+  HMM_Mat4 vp;
+  Color color;
+  float grid[4];  // Number of cells, and lines (1) or surface (0) mode.
+};
+
+struct AxesVertex {
+  HMM_Vec3 position;
+  Color color;
+};
+
+// Per instance model matrix layout, as uploaded by the renderer.
+const auto kModelLayout = sg_vertex_buffer_layout_state{
+    .stride = sizeof(HMM_Mat4), .step_func = SG_VERTEXSTEP_PER_INSTANCE};
+sg_vertex_attr_state ModelAttr(int _buffer, int _column) {
+  return {.buffer_index = _buffer,
+          .offset = _column * static_cast<int>(sizeof(HMM_Vec4)),
+          .format = SG_VERTEXFORMAT_FLOAT4};
+}
+}  // namespace
+
+void Gizmos::Initialize() {
+  // Axes shader
+  auto axes_shader_desc = sg_shader_desc{.label = "flip: Axes"};
+  axes_shader_desc.vs.source = VS_VERSION
+      "uniform mat4 vp;\n"
+      "layout(location=0) in vec3 position;\n"
+      "layout(location=1) in vec4 color;\n"
+      "layout(location=2) in mat4 model;\n"
+      "out vec4 vertex_color;\n"
+      "void main() {\n"
+      "  gl_Position = vp * model * vec4(position, 1.);\n"
+      "  vertex_color = color;\n"
+      "}\n";
+  axes_shader_desc.vs.uniform_blocks[0] = {
+      .size = sizeof(AxesUniforms),
+      .uniforms = {{.name = "vp", .type = SG_UNIFORMTYPE_MAT4}}};
+  axes_shader_desc.fs.source = FS_VERSION
+      "in vec4 vertex_color;\n"
+      "out vec4 frag_color;\n"
+      "void main() {\n"
+      "  frag_color = vertex_color;\n"
+      "}\n";
+  axes_shader_ = MakeSgShader(axes_shader_desc);
+
+  axes_pipeline_ = MakeSgPipeline(sg_pipeline_desc{
+      .shader = axes_shader_.id(),
+      .layout = {.buffers = {{.stride = sizeof(AxesVertex)}, kModelLayout},
+                 .attrs = {{.buffer_index = 0,
+                            .offset = offsetof(AxesVertex, position),
+                            .format = SG_VERTEXFORMAT_FLOAT3},
+                           {.buffer_index = 0,
+                            .offset = offsetof(AxesVertex, color),
+                            .format = SG_VERTEXFORMAT_FLOAT4},
+                           ModelAttr(1, 0), ModelAttr(1, 1), ModelAttr(1, 2),
+                           ModelAttr(1, 3)}},
+      .depth = {.compare = SG_COMPAREFUNC_LESS_EQUAL, .write_enabled = true},
+      .primitive_type = SG_PRIMITIVETYPE_LINES,
+      .label = "flip: Axes"});
+
+  const AxesVertex axes[] = {{{0, 0, 0}, kRed},   {{1, 0, 0}, kRed},
+                             {{0, 0, 0}, kGreen}, {{0, 1, 0}, kGreen},
+                             {{0, 0, 0}, kBlue},  {{0, 0, 1}, kBlue}};
+  axes_buffer_ = MakeSgBuffer(sg_buffer_desc{
+      .data = SG_RANGE(axes), .label = "flip: axes vertex buffer"});
+
+  // Grid shader, generating surface and lines vertices from vertex id.
+  auto grid_shader_desc = sg_shader_desc{.label = "flip: Grid"};
+  grid_shader_desc.vs.source = VS_VERSION
+      "uniform mat4 vp;\n"
+      "uniform vec4 color;\n"
+      "uniform vec4 grid;\n"
+      "layout(location=0) in mat4 model;\n"
+      "out vec4 vertex_color;\n"
+      "void main() {\n"
+      "  float extent = grid.x;\n"
+      "  vec2 xz;\n"
+      "  if (grid.y == 0.) {\n"
+      "    // Surface, as a triangle strip.\n"
+      "    xz = vec2(gl_VertexID >> 1, gl_VertexID & 1) * extent;\n"
+      "  } else {\n"
+      "    // Lines along x axis, then along z axis.\n"
+      "    int count = int(extent) + 1;\n"
+      "    int line = gl_VertexID >> 1;\n"
+      "    float end = float(gl_VertexID & 1) * extent;\n"
+      "    xz = line < count ? vec2(end, line) : vec2(line - count, end);\n"
+      "  }\n"
+      "  xz -= extent * .5;\n"
+      "  gl_Position = vp * model * vec4(xz.x, 0., xz.y, 1.);\n"
+      "  vertex_color = color;\n"
+      "}\n";
+  grid_shader_desc.vs.uniform_blocks[0] = {
+      .size = sizeof(GridUniforms),
+      .uniforms = {{.name = "vp", .type = SG_UNIFORMTYPE_MAT4},
+                   {.name = "color", .type = SG_UNIFORMTYPE_FLOAT4},
+                   {.name = "grid", .type = SG_UNIFORMTYPE_FLOAT4}}};
+  grid_shader_desc.fs.source = axes_shader_desc.fs.source;
+  grid_shader_ = MakeSgShader(grid_shader_desc);
+
+  const auto grid_layout = sg_vertex_layout_state{
+      .buffers = {kModelLayout},
+      .attrs = {ModelAttr(0, 0), ModelAttr(0, 1), ModelAttr(0, 2),
+                ModelAttr(0, 3)}};
+
+  // Alpha blended surface
+  grid_surface_pipeline_ = MakeSgPipeline(sg_pipeline_desc{
+      .shader = grid_shader_.id(),
+      .layout = grid_layout,
+      .depth = {.compare = SG_COMPAREFUNC_LESS_EQUAL, .write_enabled = false},
+      .colors = {{.blend = {.enabled = true,
+                            .src_factor_rgb = SG_BLENDFACTOR_SRC_ALPHA,
+                            .dst_factor_rgb =
+                                SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA}}},
+      .primitive_type = SG_PRIMITIVETYPE_TRIANGLE_STRIP,
+      .cull_mode = SG_CULLMODE_NONE,
+      .label = "flip: Grid surface"});
+
+  // Opaque grid lines
+  grid_lines_pipeline_ = MakeSgPipeline(sg_pipeline_desc{
+      .shader = grid_shader_.id(),
+      .layout = grid_layout,
+      .depth = {.compare = SG_COMPAREFUNC_LESS_EQUAL, .write_enabled = false},
+      .primitive_type = SG_PRIMITIVETYPE_LINES,
+      .label = "flip: Grid lines"});
+}
+
+bool Gizmos::DrawAxes(int _intances, const BufferBinding& _models,
+                      const HMM_Mat4& _view_proj) {
+  sg_apply_pipeline(axes_pipeline_.id());
+
+  auto bindings = sg_bindings{};
+  bindings.vertex_buffers[0] = axes_buffer_.id();
+  bindings.vertex_buffers[1] = _models.id;
+  bindings.vertex_buffer_offsets[1] = _models.offset;
+  sg_apply_bindings(bindings);
+
+  const auto uniforms = AxesUniforms{.vp = _view_proj};
+  sg_apply_uniforms(SG_SHADERSTAGE_VS, 0, SG_RANGE(uniforms));
+
+  sg_draw(0, 6, _intances);
+  return true;
+}
+
+bool Gizmos::DrawGrids(int _cells, int _intances, const BufferBinding& _models,
+                       const HMM_Mat4& _view_proj) {
+  auto bindings = sg_bindings{};
+  bindings.vertex_buffers[0] = _models.id;
+  bindings.vertex_buffer_offsets[0] = _models.offset;
+
+  const float cells = static_cast<float>(_cells);
+
+  // Alpha blended surface
+  {
+    sg_apply_pipeline(grid_surface_pipeline_.id());
+    sg_apply_bindings(bindings);
+    const auto uniforms = GridUniforms{
+        .vp = _view_proj, .color = {.5f, .7f, .8f, .6f}, .grid = {cells, 0}};
+    sg_apply_uniforms(SG_SHADERSTAGE_VS, 0, SG_RANGE(uniforms));
+    sg_draw(0, 4, _intances);
+  }
+
+  // Opaque grid lines, along x and z axes.
+  {
+    sg_apply_pipeline(grid_lines_pipeline_.id());
+    sg_apply_bindings(bindings);
+    const auto uniforms = GridUniforms{
+        .vp = _view_proj, .color = {.9f, .9f, .9f, 1.f}, .grid = {cells, 1}};
+    sg_apply_uniforms(SG_SHADERSTAGE_VS, 0, SG_RANGE(uniforms));
+    sg_draw(0, (_cells + 1) * 4, _intances);
+  }
+
+  return true;
+}
+
+}  // namespace flip
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "flip/renderer.h"
+#include "flip/utils/sokol_gfx.h"
+
+namespace flip {
+
+// Instanced rendering of axes and grids.
+class Gizmos {
+ public:
+  Gizmos() = default;
+  ~Gizmos() = default;
+
+  void Initialize();
+
+  bool DrawAxes(int _intances, const BufferBinding& _models,
+                const HMM_Mat4& _view_proj);
+  bool DrawGrids(int _cells, int _intances, const BufferBinding& _models,
+                 const HMM_Mat4& _view_proj);
+
+ protected:
+ private:
+  // Axes are made of static colored lines.
+  SgShader axes_shader_;
+  SgPipeline axes_pipeline_;
+  SgBuffer axes_buffer_;
+
+  // Grid vertices are generated by the shader from vertex id, so any number
+  // of cells can be rendered without rebuilding geometry.
+  SgShader grid_shader_;
+  SgPipeline grid_surface_pipeline_;
+  SgPipeline grid_lines_pipeline_;
+};
+
+}  // namespace flip
@@ -0,0 +1,197 @@
+#include "gpu_timers.h"
+
+#include <cassert>
+
+#include "imgui/imgui.h"
+
+#if defined(SOKOL_GLCORE33)
+#define FLIP_GPU_TIMERS
+#if defined(__APPLE__)
+#include <OpenGL/gl3.h>
+#elif defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <GL/gl.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+#endif  // SOKOL_GLCORE33
+
+namespace flip {
+
+#if defined(FLIP_GPU_TIMERS) && defined(_WIN32)
+namespace {
+// Timer query functions aren't exported by opengl32.dll, they are loaded
+// from the current context.
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#define GL_TIMESTAMP 0x8E28
+using GLuint64 = uint64_t;
+using PFNGLGENQUERIES = void(APIENTRY*)(GLsizei, GLuint*);
+using PFNGLDELETEQUERIES = void(APIENTRY*)(GLsizei, const GLuint*);
+using PFNGLQUERYCOUNTER = void(APIENTRY*)(GLuint, GLenum);
+using PFNGLGETQUERYOBJECTIV = void(APIENTRY*)(GLuint, GLenum, GLint*);
+using PFNGLGETQUERYOBJECTUI64V = void(APIENTRY*)(GLuint, GLenum, GLuint64*);
+PFNGLGENQUERIES glGenQueries;
+PFNGLDELETEQUERIES glDeleteQueries;
+PFNGLQUERYCOUNTER glQueryCounter;
+PFNGLGETQUERYOBJECTIV glGetQueryObjectiv;
+PFNGLGETQUERYOBJECTUI64V glGetQueryObjectui64v;
+
+template <typename _Fn>
+bool Load(_Fn& _fn, const char* _name) {
+  _fn = reinterpret_cast<_Fn>(wglGetProcAddress(_name));
+  return _fn != nullptr;
+}
+bool LoadTimerFunctions() {
+  return Load(glGenQueries, "glGenQueries") &&
+         Load(glDeleteQueries, "glDeleteQueries") &&
+         Load(glQueryCounter, "glQueryCounter") &&
+         Load(glGetQueryObjectiv, "glGetQueryObjectiv") &&
+         Load(glGetQueryObjectui64v, "glGetQueryObjectui64v");
+}
+}  // namespace
+#endif  // FLIP_GPU_TIMERS && _WIN32
+
+GpuTimers::GpuTimers() {
+#if defined(FLIP_GPU_TIMERS)
+#if defined(_WIN32)
+  available_ = LoadTimerFunctions();
+#else
+  available_ = true;  // Timer queries are core since GL 3.3.
+#endif  // _WIN32
+#endif  // FLIP_GPU_TIMERS
+}
+
+GpuTimers::~GpuTimers() {
+#if defined(FLIP_GPU_TIMERS)
+  for (auto& frame : frames_) {
+    if (!frame.queries.empty()) {
+      glDeleteQueries(static_cast<GLsizei>(frame.queries.size()),
+                      frame.queries.data());
+    }
+  }
+#endif  // FLIP_GPU_TIMERS
+}
+
+void GpuTimers::BeginFrame() {
+  if (!available_) {
+    return;
+  }
+
+  // Reuses queries of the oldest frame, once their results are read back.
+  slot_ = (slot_ + 1) % kLatency;
+  Collect(slot_);
+  auto& frame = frames_[slot_];
+  frame.pairs = 0;
+  frame.sections.clear();
+  Timestamp(0);
+}
+
+void GpuTimers::EndFrame() {
+  if (!available_) {
+    return;
+  }
+  assert(!in_section_ && "Section isn't ended.");
+  Timestamp(1);
+  frames_[slot_].pending = true;
+}
+
+void GpuTimers::Begin(Section _section) {
+  if (!available_) {
+    return;
+  }
+  assert(!in_section_ && "Sections can't be nested.");
+  auto& frame = frames_[slot_];
+  frame.sections.push_back(_section);
+  Timestamp(2 + frame.pairs * 2);
+  in_section_ = true;
+}
+
+void GpuTimers::End() {
+  if (!available_) {
+    return;
+  }
+  assert(in_section_ && "No section to end.");
+  auto& frame = frames_[slot_];
+  Timestamp(2 + frame.pairs * 2 + 1);
+  ++frame.pairs;
+  in_section_ = false;
+}
+
+void GpuTimers::Timestamp(size_t _index) {
+#if defined(FLIP_GPU_TIMERS)
+  auto& queries = frames_[slot_].queries;
+  if (_index >= queries.size()) {
+    // Allocates queries by pairs, which are kept from one frame to the next.
+    const auto first = queries.size();
+    queries.resize(_index + 2 - _index % 2);
+    glGenQueries(static_cast<GLsizei>(queries.size() - first),
+                 queries.data() + first);
+  }
+  glQueryCounter(queries[_index], GL_TIMESTAMP);
+#endif  // FLIP_GPU_TIMERS
+}
+
+void GpuTimers::Collect(int _slot) {
+#if defined(FLIP_GPU_TIMERS)
+  auto& frame = frames_[_slot];
+  if (!frame.pending) {
+    return;
+  }
+  frame.pending = false;
+
+  // Results are skipped rather than waited for, if GPU is more than kLatency
+  // frames late. Pass end is the last query to complete.
+  GLint available = 0;
+  glGetQueryObjectiv(frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available) {
+    return;
+  }
+
+  auto elapsed = [&frame](size_t _begin) {
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(frame.queries[_begin], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(frame.queries[_begin + 1], GL_QUERY_RESULT, &end);
+    return static_cast<float>(end - begin) * 1e-6f;  // ns to ms
+  };
+
+  float times[kSectionCount] = {};
+  for (int i = 0; i < frame.pairs; ++i) {
+    times[frame.sections[i]] += elapsed(2 + i * 2);
+  }
+
+  // Custom time is what isn't covered by other sections.
+  const float pass = elapsed(0);
+  times[kCustom] = pass;
+  for (int i = 0; i < kSectionCount; ++i) {
+    if (i != kCustom) {
+      times[kCustom] -= times[i];
+    }
+  }
+
+  for (int i = 0; i < kSectionCount; ++i) {
+    records_[i].push(times[i]);
+  }
+  pass_record_.push(pass);
+#endif  // FLIP_GPU_TIMERS
+}
+
+void GpuTimers::Gui() const {
+  if (!available_) {
+    ImGui::TextUnformatted("GPU timers aren't available.");
+    return;
+  }
+  const char* kNames[kSectionCount] = {"Shapes", "ImDraw", "Gizmos", "Imgui",
+                                       "Custom"};
+  plot("GPU pass", pass_record_);
+  for (int i = 0; i < kSectionCount; ++i) {
+    plot(kNames[i], records_[i]);
+  }
+}
+
+}  // namespace flip
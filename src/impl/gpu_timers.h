@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "flip/utils/profile.h"
+
+namespace flip {
+
+// Measures GPU time spent in renderer sections, using GL timestamp queries.
+// Results are read back kLatency frames later, to avoid stalling the GPU.
+// Timers are unavailable with GLES3/WebGL2, which have no timer queries.
+class GpuTimers {
+ public:
+  GpuTimers();
+  ~GpuTimers();
+
+  enum Section {
+    kShapes,  // Shapes instanced rendering
+    kImDraw,  // ImDraw scopes, immediate or batched
+    kGizmos,  // Axes and grids
+    kImgui,   // Imgui and debug ui
+    kCustom,  // Remaining pass time, including user custom rendering
+    kSectionCount
+  };
+
+  // Begins/ends timing of the rendering pass, within which sections are
+  // timed.
+  void BeginFrame();
+  void EndFrame();
+
+  // Begins/ends timing of a section. Sections can't be nested. A section can
+  // be timed many times per frame, its intervals are summed.
+  void Begin(Section _section);
+  void End();
+
+  // RAII section timing.
+  class Scope {
+   public:
+    Scope(GpuTimers& _timers, Section _section) : timers_{_timers} {
+      timers_.Begin(_section);
+    }
+    ~Scope() { timers_.End(); }
+
+   private:
+    GpuTimers& timers_;
+  };
+
+  bool available() const { return available_; }
+
+  // Renders sections records with imgui.
+  void Gui() const;
+
+ private:
+  // Reads back results of a frame, if they are available.
+  void Collect(int _slot);
+
+  // Writes a timestamp to query _index of the current frame.
+  void Timestamp(size_t _index);
+
+  static constexpr int kLatency = 4;
+
+  // Queries of a frame. First two are pass begin/end timestamps, then
+  // begin/end pairs of sections. Queries are pooled, growing with the number
+  // of pairs and kept from one frame to the next.
+  struct Frame {
+    std::vector<uint32_t> queries;
+    std::vector<Section> sections;
+    int pairs = 0;
+    bool pending = false;
+  };
+  Frame frames_[kLatency];
+  int slot_ = 0;
+  bool in_section_ = false;
+
+  bool available_ = false;
+
+  // Per section ms records, and whole pass.
+  ProfileRecord records_[kSectionCount];
+  ProfileRecord pass_record_;
+};
+
+}  // namespace flip
@@ -1,49 +1,157 @@
 #include "imdrawer.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstring>
+#include <string>
 
 #include "sokol/sokol_app.h"
 
 namespace flip {
 
-ImDrawer::ImDrawer() {
+namespace {
+// Vertex layouts, depending on mode format and primitive type.
+struct Layout {
+  bool packed;  // Position is followed by packed color
+  bool uv;      // Has uv attribute
+  bool size;    // Has size attribute
+  int stride;
+};
+const Layout kLayouts[] = {
+    {.packed = false, .uv = true, .size = true, .stride = sizeof(ImVertex)},
+    {.packed = true, .uv = false, .size = false, .stride = 16},
+    {.packed = true, .uv = false, .size = true, .stride = 20},
+    {.packed = true, .uv = true, .size = false, .stride = 20},
+    {.packed = true, .uv = true, .size = true, .stride = 24}};
+
+// Point size is only needed for points primitives.
+int LayoutIndex(const ImMode& _mode) {
+  const bool points = _mode.type == SG_PRIMITIVETYPE_POINTS;
+  switch (_mode.format) {
+    case ImFormat::kPacked:
+      return 1 + points;
+    case ImFormat::kPackedUv:
+      return 3 + points;
+    default:
+      return 0;
+  }
+}
+
+// Converts to half float, flushing denormals to zero.
+uint16_t PackHalf(float _f) {
+  uint32_t bits;
+  std::memcpy(&bits, &_f, sizeof(bits));
+  const uint32_t sign = (bits >> 16) & 0x8000;
+  const int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+  const uint32_t mantissa = bits & 0x7fffff;
+  if (exponent <= 0) {
+    return static_cast<uint16_t>(sign);
+  }
+  if (exponent >= 31) {
+    return static_cast<uint16_t>(sign | 0x7c00);
+  }
+  // Rounds to nearest, a carry correctly increments the exponent.
+  return static_cast<uint16_t>(sign | ((exponent << 10) +
+                                       ((mantissa + 0x1000) >> 13)));
+}
+
+// Converts to 4 normalized bytes, in rgba memory order.
+std::array<uint8_t, 4> PackColor(const Color& _color) {
+  std::array<uint8_t, 4> packed;
+  for (int i = 0; i < 4; ++i) {
+    const float c = std::clamp(_color.rgba[i], 0.f, 1.f);
+    packed[i] = static_cast<uint8_t>(c * 255.f + .5f);
+  }
+  return packed;
+}
+
+template <typename _Ty>
+std::byte* Write(std::byte* _out, const _Ty& _value) {
+  std::memcpy(_out, &_value, sizeof(_Ty));
+  return _out + sizeof(_Ty);
+}
+
+// Appends _vertices to _stream, according to _layout. Positions are
+// transformed by _transform, unless it's nullptr.
+void Pack(std::span<const ImVertex> _vertices, const Layout& _layout,
+          const HMM_Mat4* _transform, std::vector<std::byte>& _stream) {
+  const auto offset = _stream.size();
+  _stream.resize(offset + _vertices.size() * _layout.stride);
+  auto* out = _stream.data() + offset;
+  for (const auto& vertex : _vertices) {
+    const auto position =
+        _transform ? (*_transform * HMM_V4V(vertex.position, 1.f)).XYZ
+                   : vertex.position;
+    if (!_layout.packed) {
+      auto full = vertex;
+      full.position = position;
+      out = Write(out, full);
+      continue;
+    }
+    out = Write(out, position);
+    out = Write(out, PackColor(vertex.color));
+    if (_layout.uv) {
+      out = Write(out, std::array<uint16_t, 2>{PackHalf(vertex.uv.X),
+                                               PackHalf(vertex.uv.Y)});
+    }
+    if (_layout.size) {
+      out = Write(out, vertex.size);
+    }
+  }
+}
+}  // namespace
+
+ImDrawer::ImDrawer() : pipelines_(kModeKeyCount) {
   // Shader
   auto shader_desc = sg_shader_desc{.label = "flip:: ImDrawer"};
   shader_desc.vs.uniform_blocks[0] = {
       .size = sizeof(HMM_Mat4),
       .uniforms = {{.name = "mvp", .type = SG_UNIFORMTYPE_MAT4}}};
-  shader_desc.vs.source = VS_VERSION
+  shader_desc.fs.images[0] = {.used = true};
+  shader_desc.fs.samplers[0] = {.used = true};
+  shader_desc.fs.image_sampler_pairs[0] = {
+      .used = true, .image_slot = 0, .sampler_slot = 0, .glsl_name = "tex"};
+
+  // Attributes locations are contiguous, depending on the layout.
+  const char* vs_source =
       "uniform mat4 mvp;\n"
       "layout(location=0) in vec3 position;\n"
       "layout(location=1) in vec4 color;\n"
+      "#ifdef VERTEX_UV\n"
       "layout(location=2) in vec2 uv;\n"
-      "layout(location=3) in float size;\n"
+      "#endif\n"
+      "#ifdef VERTEX_SIZE\n"
+      "layout(location=VERTEX_SIZE) in float size;\n"
+      "#endif\n"
       "out vec2 vertex_uv;\n"
       "out vec4 vertex_color;\n"
       "void main() {\n"
       "  gl_Position = mvp * vec4(position, 1.);\n"
+      "#ifdef VERTEX_SIZE\n"
       "  gl_PointSize = size;\n"
+      "#endif\n"
+      "#ifdef VERTEX_UV\n"
       "  vertex_uv = uv;\n"
+      "#else\n"
+      "  vertex_uv = vec2(0.);\n"
+      "#endif\n"
       "  vertex_color = color;\n"
       "}\n";
-  shader_desc.fs.images[0] = {.used = true};
-  shader_desc.fs.samplers[0] = {.used = true};
-  shader_desc.fs.image_sampler_pairs[0] = {
-      .used = true, .image_slot = 0, .sampler_slot = 0, .glsl_name = "tex"};
 
   // Without alpha test.
-  shader_desc.fs.source = FS_VERSION
+  const char* fs_sources[2] = {
+      FS_VERSION
       "uniform sampler2D tex;\n"
       "in vec2 vertex_uv;\n"
       "in vec4 vertex_color;\n"
       "out vec4 frag_color;\n"
       "void main() {\n"
       "  frag_color = texture(tex, vertex_uv) * vertex_color;\n"
-      "}\n";
-  shaders_[false] = flip::MakeSgShader(shader_desc);
+      "}\n",
 
-  // With alpha test (ie discard pixel).
-  shader_desc.fs.source = FS_VERSION
+      // With alpha test (ie discard pixel).
+      FS_VERSION
       "uniform sampler2D tex;\n"
       "in vec2 vertex_uv;\n"
       "in vec4 vertex_color;\n"
@@ -51,8 +159,25 @@ ImDrawer::ImDrawer() {
       "void main() {\n"
       "  frag_color = texture(tex, vertex_uv) * vertex_color;\n"
       "  if(frag_color.a <= .3) discard;\n"
-      "}\n";
-  shaders_[true] = flip::MakeSgShader(shader_desc);
+      "}\n"};
+
+  for (int uv = 0; uv < 2; ++uv) {
+    for (int size = 0; size < 2; ++size) {
+      std::string defines;
+      if (uv) {
+        defines += "#define VERTEX_UV\n";
+      }
+      if (size) {
+        defines += uv ? "#define VERTEX_SIZE 3\n" : "#define VERTEX_SIZE 2\n";
+      }
+      const auto vs = std::string(VS_VERSION) + defines + vs_source;
+      shader_desc.vs.source = vs.c_str();
+      for (int alpha_test = 0; alpha_test < 2; ++alpha_test) {
+        shader_desc.fs.source = fs_sources[alpha_test];
+        shaders_[uv][size][alpha_test] = flip::MakeSgShader(shader_desc);
+      }
+    }
+  }
 
   // Image
   uint32_t pixels[] = {0xFFFFFFFF};  // Single white pixel
@@ -62,6 +187,19 @@ ImDrawer::ImDrawer() {
                     .data = {.subimage = {{SG_RANGE(pixels)}}},
                     .label = "flip: ImDrawer default"});
 
+  // Placeholder, a grey checker.
+  uint32_t checker[4][4];
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 4; ++x) {
+      checker[y][x] = (x + y) % 2 ? 0xFF808080 : 0xFFC0C0C0;
+    }
+  }
+  placeholder_ = flip::MakeSgImage(
+      sg_image_desc{.width = 4,
+                    .height = 4,
+                    .data = {.subimage = {{SG_RANGE(checker)}}},
+                    .label = "flip: ImDrawer placeholder"});
+
   // Sampler
   sampler_ =
       flip::MakeSgSampler(sg_sampler_desc{.min_filter = SG_FILTER_LINEAR,
@@ -71,32 +209,69 @@ ImDrawer::ImDrawer() {
 
 ImDrawer::~ImDrawer() {}
 
+void ImDrawer::WarmUp(std::span<const ImMode> _modes) {
+  for (const auto& mode : _modes) {
+    auto& pipeline = pipelines_[ModeKey(mode)];
+    if (!pipeline.is_valid()) {
+      pipeline = MakePipeline(mode);
+    }
+  }
+}
+
+sg_pipeline ImDrawer::GetPipeline(const ImMode& _mode) {
+  auto& pipeline = pipelines_[ModeKey(_mode)];
+  if (!pipeline.is_valid()) {
+    // Mode wasn't declared for warm-up, pipeline creation may hitch.
+    pipeline = MakePipeline(_mode);
+    ++late_pipelines_;
+  }
+  return pipeline.id();
+}
+
+SgPipeline ImDrawer::MakePipeline(const ImMode& _mode) {
+  // Vertex attributes, contiguous.
+  const auto& layout = kLayouts[LayoutIndex(_mode)];
+  auto layout_desc = sg_vertex_layout_state{
+      .buffers = {{.stride = layout.stride}},
+      .attrs = {{.format = SG_VERTEXFORMAT_FLOAT3},
+                {.format = layout.packed ? SG_VERTEXFORMAT_UBYTE4N
+                                         : SG_VERTEXFORMAT_FLOAT4}}};
+  int attr = 2;
+  if (layout.uv) {
+    layout_desc.attrs[attr++].format =
+        layout.packed ? SG_VERTEXFORMAT_HALF2 : SG_VERTEXFORMAT_FLOAT2;
+  }
+  if (layout.size) {
+    layout_desc.attrs[attr++].format = SG_VERTEXFORMAT_FLOAT;
+  }
+
+  const auto& shader = shaders_[layout.uv][layout.size][_mode.alpha_test];
+  return MakeSgPipeline(sg_pipeline_desc{
+      .shader = shader.id(),
+      .layout = layout_desc,
+      .depth = {.compare = _mode.z_compare, .write_enabled = _mode.z_write},
+      .colors = {{.blend = {.enabled = _mode.alpha_blending,
+                            .src_factor_rgb = SG_BLENDFACTOR_SRC_ALPHA,
+                            .dst_factor_rgb =
+                                SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA
+
+                  }}},
+      .primitive_type = _mode.type,
+      .cull_mode = _mode.cull_mode,
+      .alpha_to_coverage_enabled = _mode.alpha_to_coverage,
+      .label = "flip: ImDrawer"});
+}
+
 void ImDrawer::Begin(const HMM_Mat4& _view_proj, const HMM_Mat4& _transform,
                      const ImMode& _mode) {
-  auto it = pipelines_.find(_mode);
-  if (it == pipelines_.end()) {
-    sg_pipeline pip = sg_make_pipeline(sg_pipeline_desc{
-        .shader = shaders_[_mode.alpha_test].id(),
-        .layout = {.buffers = {{.stride = sizeof(ImVertex)}},
-                   .attrs = {{.format = SG_VERTEXFORMAT_FLOAT3},
-                             {.format = SG_VERTEXFORMAT_FLOAT4},
-                             {.format = SG_VERTEXFORMAT_FLOAT2},
-                             {.format = SG_VERTEXFORMAT_FLOAT}}},
-        .depth = {.compare = _mode.z_compare, .write_enabled = _mode.z_write},
-        .colors = {{.blend = {.enabled = _mode.alpha_blending,
-                              .src_factor_rgb = SG_BLENDFACTOR_SRC_ALPHA,
-                              .dst_factor_rgb =
-                                  SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA
-
-                    }}},
-        .primitive_type = _mode.type,
-        .cull_mode = _mode.cull_mode,
-        .alpha_to_coverage_enabled = _mode.alpha_to_coverage,
-        .label = "flip: ImDrawer"});
-    it = pipelines_.emplace(_mode, pip).first;
-  }
-
-  sg_apply_pipeline(it->second.id());
+  // Records scope state, which is consumed by End().
+  transform_ = _transform;
+  mode_ = _mode;
+  if (deferred_) {
+    return;
+  }
+
+  sg_apply_pipeline(GetPipeline(_mode));
 
   const auto mvp = _view_proj * _transform;
   sg_apply_uniforms(SG_SHADERSTAGE_VS, 0, {mvp.Elements[0], sizeof(mvp)});
@@ -104,16 +279,106 @@ void ImDrawer::Begin(const HMM_Mat4& _view_proj, const HMM_Mat4& _transform,
 
 void ImDrawer::End(std::span<const ImVertex> _vertices, sg_image _image,
                    sg_sampler _sampler) {
-  // Updates vertices buffer
-  auto buffer_binding = buffer_.Append(std::as_bytes(_vertices));
-
-  sg_apply_bindings(sg_bindings{
-      .vertex_buffers = {buffer_binding.id},
-      .vertex_buffer_offsets = {buffer_binding.offset},
-      .fs = {.images = {_image.id != SG_INVALID_ID ? _image : image_.id()},
-             .samplers = {_sampler.id != SG_INVALID_ID ? _sampler
-                                                       : sampler_.id()}}});
+  auto image = _image.id != SG_INVALID_ID ? _image : image_.id();
+  if (sg_query_image_state(image) != SG_RESOURCESTATE_VALID) {
+    image = placeholder_.id();  // Loading, or failed to load.
+  }
+  const auto sampler = _sampler.id != SG_INVALID_ID ? _sampler : sampler_.id();
+  const auto layout_index = LayoutIndex(mode_);
+  const auto& layout = kLayouts[layout_index];
+
+  ++scopes_;
+  if (deferred_) {
+    if (_vertices.empty()) {
+      return;
+    }
+
+    // Vertices are transformed to world space, so scopes with different
+    // transforms can be rendered by the same draw call.
+    auto& stream = streams_[layout_index];
+    const auto first = static_cast<int>(stream.size() / layout.stride);
+    Pack(_vertices, layout, &transform_, stream);
+
+    // Strips can't be merged without connecting them. Last batch is also the
+    // last one of its stream.
+    const bool mergeable = mode_.type == SG_PRIMITIVETYPE_POINTS ||
+                           mode_.type == SG_PRIMITIVETYPE_LINES ||
+                           mode_.type == SG_PRIMITIVETYPE_TRIANGLES;
+    if (mergeable && !batches_.empty()) {
+      auto& last = batches_.back();
+      if (last.mode == mode_ && last.image.id == image.id &&
+          last.sampler.id == sampler.id) {
+        last.count += static_cast<int>(_vertices.size());
+        return;
+      }
+    }
+    batches_.push_back(Batch{.mode = mode_,
+                             .image = image,
+                             .sampler = sampler,
+                             .first = first,
+                             .count = static_cast<int>(_vertices.size())});
+    return;
+  }
+
+  // Updates vertices buffer, full format is uploaded as is.
+  auto data = std::as_bytes(_vertices);
+  if (layout.packed) {
+    scratch_.clear();
+    Pack(_vertices, layout, nullptr, scratch_);
+    data = scratch_;
+  }
+  auto buffer_binding = buffer_.Append(data);
+
+  sg_apply_bindings(
+      sg_bindings{.vertex_buffers = {buffer_binding.id},
+                  .vertex_buffer_offsets = {buffer_binding.offset},
+                  .fs = {.images = {image}, .samplers = {sampler}}});
   sg_draw(0, _vertices.size(), 1);
+  ++draws_;
+}
+
+void ImDrawer::EndFrame() {
+  assert(batches_.empty() && "Recorded scopes weren't flushed.");
+  stats_ = {.scopes = scopes_,
+            .draws = draws_,
+            .late_pipelines = late_pipelines_};
+  scopes_ = draws_ = 0;
+}
+
+void ImDrawer::Flush(const HMM_Mat4& _view_proj) {
+  if (batches_.empty()) {
+    return;
+  }
+  draws_ += static_cast<int>(batches_.size());
+
+  // Updates vertices buffer once per layout for all scopes of the frame.
+  BufferBinding bindings[kLayoutCount] = {};
+  for (int i = 0; i < kLayoutCount; ++i) {
+    if (!streams_[i].empty()) {
+      bindings[i] = buffer_.Append(streams_[i]);
+      streams_[i].clear();
+    }
+  }
+
+  sg_pipeline current = {SG_INVALID_ID};
+  for (const auto& batch : batches_) {
+    const auto pipeline = GetPipeline(batch.mode);
+    if (pipeline.id != current.id) {
+      current = pipeline;
+      sg_apply_pipeline(pipeline);
+      sg_apply_uniforms(SG_SHADERSTAGE_VS, 0,
+                        {_view_proj.Elements[0], sizeof(_view_proj)});
+    }
+    const auto& binding = bindings[LayoutIndex(batch.mode)];
+    sg_apply_bindings(
+        sg_bindings{.vertex_buffers = {binding.id},
+                    .vertex_buffer_offsets = {binding.offset},
+                    .fs = {.images = {batch.image},
+                           .samplers = {batch.sampler}}});
+    sg_draw(batch.first, batch.count, 1);
+  }
+
+  batches_.clear();
 }
 
-}  // namespace flip
\ No newline at end of file
+}  // namespace flip
@@ -1,30 +1,29 @@
 #pragma once
 
-#include <unordered_map>
+#include <cstdint>
+#include <vector>
 
 #include "flip/imdraw.h"
 
 namespace flip {
 
-inline bool operator==(ImMode const& _a, ImMode const& _b) noexcept {
-  return _a.type == _b.type && _a.z_write == _b.z_write &&
-         _a.z_compare == _b.z_compare && _a.cull_mode == _b.cull_mode &&
-         _a.alpha_blending == _b.alpha_blending &&
-         _a.alpha_test == _b.alpha_test &&
-         _a.alpha_to_coverage == _b.alpha_to_coverage;
+// Packs all mode states into a dense key, used to index pipelines.
+constexpr uint32_t ModeKey(const ImMode& _mode) {
+  return uint32_t(_mode.type) << 0 | uint32_t(_mode.z_write) << 3 |
+         uint32_t(_mode.z_compare) << 4 | uint32_t(_mode.cull_mode) << 8 |
+         uint32_t(_mode.alpha_blending) << 10 |
+         uint32_t(_mode.alpha_test) << 11 |
+         uint32_t(_mode.alpha_to_coverage) << 12 |
+         uint32_t(_mode.format) << 13;
 }
+constexpr uint32_t kModeKeyCount = 1 << 15;
+static_assert(_SG_PRIMITIVETYPE_NUM <= 1 << 3 &&
+                  _SG_COMPAREFUNC_NUM <= 1 << 4 && _SG_CULLMODE_NUM <= 1 << 2,
+              "Mode states don't fit in their key bits.");
 
-struct ModeHash {
-  std::size_t operator()(ImMode const& _mode) const noexcept {
-    auto hash = std::size_t(_mode.type) << 0 | std::size_t(_mode.z_write) << 3 |
-                std::size_t(_mode.z_compare) << 4 |
-                std::size_t(_mode.cull_mode) << 13 |
-                std::size_t(_mode.alpha_blending) << 15 |
-                std::size_t(_mode.alpha_test) << 16 |
-                std::size_t(_mode.alpha_to_coverage) << 17;
-    return hash;
-  }
-};
+inline bool operator==(ImMode const& _a, ImMode const& _b) noexcept {
+  return ModeKey(_a) == ModeKey(_b);
+}
 
 class ImDrawer {
  public:
@@ -36,17 +35,88 @@ class ImDrawer {
   void End(std::span<const ImVertex> _vertices, sg_image _image,
            sg_sampler _sampler);
 
+  // Deferred mode records scopes into a command list instead of drawing them
+  // immediately. Recorded scopes are rendered by Flush().
+  void set_deferred(bool _deferred) { deferred_ = _deferred; }
+  bool deferred() const { return deferred_; }
+
+  // Uploads all vertices recorded since last flush at once, and renders them
+  // with as few draw calls as possible.
+  void Flush(const HMM_Mat4& _view_proj);
+
+  // Returns true if recorded scopes are waiting for a flush.
+  bool pending() const { return !batches_.empty(); }
+
+  // Updates stats of the frame, once all scopes are flushed.
+  void EndFrame();
+
+  // Builds pipelines of all _modes up front, so they aren't created while
+  // rendering. Any pipeline created later is counted as a late pipeline.
+  void WarmUp(std::span<const ImMode> _modes);
+
+  // Number of scopes and draw calls of the last frame, and number of
+  // pipelines created after warm-up.
+  struct Stats {
+    int scopes;
+    int draws;
+    int late_pipelines;
+  };
+  const Stats& stats() const { return stats_; }
+
+  // Up to date number of pipelines created after warm-up.
+  int late_pipelines() const { return late_pipelines_; }
+
+  const SgDynamicBuffer& buffer() const { return buffer_; }
+
  protected:
  private:
-  std::unordered_map<ImMode, SgPipeline, ModeHash> pipelines_;
+  sg_pipeline GetPipeline(const ImMode& _mode);
+  SgPipeline MakePipeline(const ImMode& _mode);
+
+  // Pipelines indexed by mode key, created on demand.
+  std::vector<SgPipeline> pipelines_;
+  int late_pipelines_ = 0;
 
-  // Shaders with / without alpha test enabled.
-  SgShader shaders_[2];
+  // Shaders with / without uv attribute, with / without size attribute, and
+  // with / without alpha test enabled.
+  SgShader shaders_[2][2][2];
 
   SgDynamicBuffer buffer_;
 
   SgImage image_;
   SgSampler sampler_;  // nearest & linear
+
+  // Rendered instead of images that aren't loaded (yet).
+  SgImage placeholder_;
+
+  // Deferred mode, opt-in as it changes draw order.
+  bool deferred_ = false;
+
+  // Consecutive scopes sharing the same mode, image and sampler.
+  struct Batch {
+    ImMode mode;
+    sg_image image;
+    sg_sampler sampler;
+    int first;  // First vertex in its layout stream
+    int count;  // Number of vertices
+  };
+  std::vector<Batch> batches_;
+
+  // Vertices of all scopes recorded this frame, in world space, packed in a
+  // stream per vertex layout.
+  static constexpr int kLayoutCount = 5;
+  std::vector<std::byte> streams_[kLayoutCount];
+
+  // Packed vertices of the current scope, when not deferred.
+  std::vector<std::byte> scratch_;
+
+  // Current scope state.
+  HMM_Mat4 transform_;
+  ImMode mode_;
+
+  Stats stats_ = {};
+  int scopes_ = 0;
+  int draws_ = 0;
 };
 
-};  // namespace flip
\ No newline at end of file
+};  // namespace flip
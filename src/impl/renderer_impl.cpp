@@ -1,5 +1,10 @@
 #include "renderer_impl.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
 // Sokol library, do not sort includes
 // clang-format off
 #include "sokol/sokol_app.h"
@@ -15,11 +20,17 @@
 
 // flip interfaces
 #include "flip/camera.h"
+#include "flip/command_buffer.h"
 #include "flip/math.h"
+#include "flip/utils/profile.h"
 #include "flip/utils/sokol_gfx.h"
 
 // flip implementations
+#include "culling.h"
 #include "factory.h"
+#include "frame_arena.h"
+#include "gizmos.h"
+#include "gpu_timers.h"
 #include "imdrawer.h"
 #include "imgui.h"
 #include "shapes.h"
@@ -31,6 +42,35 @@ struct RendererImpl::Resources {
   // flip imgui
   Imgui imgui;
 
+  // Offscreen render target, used instead of the default framebuffer when
+  // pass is valid. It's recreated when window size changes.
+  SgImage offscreen_color;
+  SgImage offscreen_depth;
+  SgPass offscreen_pass;
+  int offscreen_width = 0;
+  int offscreen_height = 0;
+
+  void SetupOffscreen() {
+    // Matches default framebuffer formats, so pipelines remain compatible.
+    const auto context = sapp_sgcontext();
+    offscreen_pass.reset();
+    offscreen_width = sapp_width();
+    offscreen_height = sapp_height();
+    auto desc = sg_image_desc{.render_target = true,
+                              .width = offscreen_width,
+                              .height = offscreen_height,
+                              .sample_count = context.sample_count,
+                              .label = "flip: offscreen"};
+    desc.pixel_format = context.color_format;
+    offscreen_color = MakeSgImage(desc);
+    desc.pixel_format = context.depth_format;
+    offscreen_depth = MakeSgImage(desc);
+    offscreen_pass = MakeSgPass(sg_pass_desc{
+        .color_attachments = {{.image = offscreen_color.id()}},
+        .depth_stencil_attachment = {.image = offscreen_depth.id()},
+        .label = "flip: offscreen"});
+  }
+
   // Context for debug-inspection UI for sokol_gfx.h
   struct SgImgui {
     SgImgui() {
@@ -43,28 +83,95 @@ struct RendererImpl::Resources {
     sg_imgui_t context;
   } sg_imgui;
 
+  // GPU time of renderer sections.
+  GpuTimers gpu_timers;
+
   // flip imdrawer
   ImDrawer im_drawer;
 
-  // Buffer of transforms used for instanced rendering.
-  SgDynamicBuffer transforms_buffer;
+  // ImDraw vertices recorded during the frame.
+  FrameArena<ImVertex> im_arena{1024};
+
+  // Command lists submitted during the frame.
+  std::vector<const CommandList*> command_lists;
+
+  // Buffer of transforms used for instanced rendering. Preallocated for a
+  // thousand matrices.
+  SgDynamicBuffer transforms_buffer{sizeof(HMM_Mat4) << 10};
+
+  // Buffer of colors used for per instance colored rendering.
+  SgDynamicBuffer colors_buffer;
 
   // Primitive shapes
   Shapes shapes;
+
+  // Axes and grids
+  Gizmos gizmos;
+
+  // Instances frustum culling and level of detail selection.
+  bool culling_enabled = true;
+  Culling culling;
+
+  // Culling scratch buffers, reused from one draw to the next.
+  std::vector<std::byte> culling_spheres;
+  std::vector<std::byte> culling_lods;
+  std::vector<std::byte> culling_transforms;
+  std::vector<std::byte> culling_colors;
+
+  // Number of instances submitted and drawn per level of detail, for the
+  // current and last frames.
+  struct CullingStats {
+    size_t instances;
+    size_t lods[Shapes::kLodCount];
+  } culling_stats = {}, last_culling_stats = {};
+
+  // Retained instances. Handle id is made of slot + 1 in the low bits, and
+  // slot version in the high bits. Destroyed slots have an invalid buffer,
+  // and are reused with the next version, so stale handles aren't found.
+  struct RetainedInstances {
+    SgBuffer buffer;
+    std::vector<HMM_Mat4> transforms;  // Copy for partial updates.
+    bool dirty = false;                // Transforms need to be uploaded.
+    uint64_t update_frame = ~uint64_t{0};
+    uint32_t version = 0;
+  };
+  std::vector<RetainedInstances> retained;
+  static constexpr int kSlotBits = 16;
+  static constexpr uint32_t kSlotMask = (1u << kSlotBits) - 1;
+
+  RetainedInstances* FindRetained(Instances _instances) {
+    const auto slot = _instances.id & kSlotMask;
+    if (slot == 0 || slot > retained.size()) {
+      return nullptr;
+    }
+    auto& instances = retained[slot - 1];
+    return instances.buffer.is_valid() &&
+                   instances.version == _instances.id >> kSlotBits
+               ? &instances
+               : nullptr;
+  }
 };
 
-RendererImpl::RendererImpl() {
+RendererImpl::RendererImpl(bool _offscreen) {
   // Setups sokol gfx
   const auto& app_desc = sapp_query_desc();
+  const auto context = sapp_sgcontext();
   sg_setup(sg_desc{.logger = {.func = app_desc.logger.func,
                               .user_data = app_desc.logger.user_data},
-                   .context = sapp_sgcontext()});
+                   .context = context});
 
   // Allocates the resource container once gfx is ready
   resources_ = std::make_unique<Resources>();
 
+  if (_offscreen) {
+    resources_->SetupOffscreen();
+  }
+
   // Initialize shape resources
   resources_->shapes.Initialize();
+
+  // Initialize axes and grids resources
+  resources_->gizmos.Initialize();
 }
 
 RendererImpl::~RendererImpl() {
@@ -85,22 +192,84 @@ void RendererImpl::BeginDefaultPass(const CameraView& _view) {
   HMM_Mat4 view =
       HMM_LookAt_RH(_view.eye, _view.center, HMM_Vec3{0.0f, 1.0f, 0.0f});
   view_proj_ = proj * view;
+  ++frame_;
+
+  // Setups culling for the frame.
+  resources_->culling.Setup(view_proj_, proj.Elements[1][1]);
+  resources_->last_culling_stats = resources_->culling_stats;
+  resources_->culling_stats = {};
 
   const auto action =
       sg_pass_action{.colors = {{.load_action = SG_LOADACTION_CLEAR,
                                  .store_action = SG_STOREACTION_STORE,
                                  .clear_value = {.15f, .15f, .15f, 1.f}}}};
 
-  sg_begin_default_pass(&action, sapp_width(), sapp_height());
+  if (resources_->offscreen_pass.is_valid()) {
+    if (resources_->offscreen_width != sapp_width() ||
+        resources_->offscreen_height != sapp_height()) {
+      resources_->SetupOffscreen();
+    }
+    sg_begin_pass(resources_->offscreen_pass.id(), &action);
+  } else {
+    sg_begin_default_pass(&action, sapp_width(), sapp_height());
+  }
+  resources_->gpu_timers.BeginFrame();
 
   resources_->imgui.BeginFrame();
 }
 
 void RendererImpl::EndDefaultPass() {
-  resources_->imgui.EndFrame();
+  auto& gpu_timers = resources_->gpu_timers;
+  {  // Renders submitted command lists.
+    FLIP_PROFILE("Command lists");
+    for (const auto* list : resources_->command_lists) {
+      list->Replay(*this);
+    }
+    resources_->command_lists.clear();
+  }
+  // Renders ImDraw scopes batched since the last draw.
+  FlushImDraw();
+  resources_->im_drawer.EndFrame();
+  {
+    FLIP_PROFILE("Imgui");
+    auto gpu_scope = GpuTimers::Scope(gpu_timers, GpuTimers::kImgui);
+    resources_->imgui.EndFrame();
+  }
+  gpu_timers.EndFrame();
 
+  FLIP_PROFILE("Commit");
   sg_end_pass();
   sg_commit();
+
+  // ImDraw vertices were consumed.
+  resources_->im_arena.Reset();
+}
+
+void RendererImpl::Submit(const CommandList& _list) {
+  resources_->command_lists.push_back(&_list);
+}
+
+void RendererImpl::WarmUpImModes(std::span<const ImMode> _modes) {
+  resources_->im_drawer.WarmUp(_modes);
+}
+
+int RendererImpl::GetLatePipelines() const {
+  return resources_->im_drawer.late_pipelines();
+}
+
+void RendererImpl::BatchImDraw(bool _batch) {
+  FlushImDraw();
+  resources_->im_drawer.set_deferred(_batch);
+}
+
+void RendererImpl::FlushImDraw() {
+  auto& im_drawer = resources_->im_drawer;
+  if (!im_drawer.pending()) {
+    return;
+  }
+  FLIP_PROFILE("ImDraw flush");
+  auto gpu_scope = GpuTimers::Scope(resources_->gpu_timers, GpuTimers::kImDraw);
+  im_drawer.Flush(view_proj_);
 }
 
 void RendererImpl::BeginImDraw(const HMM_Mat4& _transform,
@@ -109,7 +278,19 @@ void RendererImpl::BeginImDraw(const HMM_Mat4& _transform,
 }
 void RendererImpl::EndImDraw(std::span<const ImVertex> _vertices,
                              sg_image _image, sg_sampler _sampler) {
-  resources_->im_drawer.End(_vertices, _image, _sampler);
+  // Deferred scopes are timed when they're flushed.
+  auto& im_drawer = resources_->im_drawer;
+  if (im_drawer.deferred()) {
+    im_drawer.End(_vertices, _image, _sampler);
+  } else {
+    auto gpu_scope =
+        GpuTimers::Scope(resources_->gpu_timers, GpuTimers::kImDraw);
+    im_drawer.End(_vertices, _image, _sampler);
+  }
+}
+std::span<ImVertex> RendererImpl::ReallocateImVertices(
+    std::span<ImVertex> _vertices, size_t _count) {
+  return resources_->im_arena.Reallocate(_vertices, _count);
 }
 
 bool RendererImpl::Menu() {
@@ -118,6 +299,33 @@ bool RendererImpl::Menu() {
     ImGui::LabelText("Resolution", "%dx%d", w, h);
     const float dpi = sapp_dpi_scale();
     ImGui::LabelText("DPI scale", "%.2g", dpi);
+    const auto& im_stats = resources_->im_drawer.stats();
+    ImGui::LabelText("ImDraw", "%d scopes, %d draws", im_stats.scopes,
+                     im_stats.draws);
+    ImGui::LabelText("ImDraw late pipelines", "%d", im_stats.late_pipelines);
+    const auto& im_arena = resources_->im_arena;
+    ImGui::LabelText("ImDraw arena", "%zu/%zu vertices",
+                     im_arena.frame_peak(), im_arena.capacity());
+    const auto& cull_stats = resources_->last_culling_stats;
+    ImGui::LabelText("Shapes", "%zu instances, %zu/%zu/%zu lods",
+                     cull_stats.instances, cull_stats.lods[0],
+                     cull_stats.lods[1], cull_stats.lods[2]);
+    auto buffer_stats = [](const char* _label, const SgDynamicBuffer& _buffer) {
+      const auto& stats = _buffer.stats();
+      ImGui::LabelText(_label, "%zu/%zu B, %d allocs", stats.frame_bytes,
+                       stats.size, stats.reallocations);
+    };
+    buffer_stats("Transforms buffer", resources_->transforms_buffer);
+    buffer_stats("Colors buffer", resources_->colors_buffer);
+    buffer_stats("ImDraw buffer", resources_->im_drawer.buffer());
+    ImGui::EndMenu();
+  }
+
+  if (ImGui::BeginMenu("Performance")) {
+    if (ImGui::TreeNodeEx("GPU")) {
+      resources_->gpu_timers.Gui();
+      ImGui::TreePop();
+    }
     ImGui::EndMenu();
   }
 
@@ -131,6 +339,12 @@ bool RendererImpl::Menu() {
     ImGui::MenuItem("Pipelines", 0, &ctx.pipelines.open);
     ImGui::MenuItem("Passes", 0, &ctx.passes.open);
     ImGui::MenuItem("Calls", 0, &ctx.capture.open);
+    ImGui::Separator();
+    bool deferred = resources_->im_drawer.deferred();
+    if (ImGui::MenuItem("Batch ImDraw", 0, &deferred)) {
+      BatchImDraw(deferred);
+    }
+    ImGui::MenuItem("Cull shapes", 0, &resources_->culling_enabled);
     ImGui::EndMenu();
   }
   sg_imgui_draw(&ctx);
@@ -138,91 +352,305 @@ bool RendererImpl::Menu() {
   return true;
 }
 
+namespace {
+// Shapes bounding sphere radius, all centered on local origin. Cylinder's is
+// conservative, to also cover a cylinder based on its origin.
+const float kShapeRadius[Renderer::Shape::kCount] = {
+    .7072f,  // kPlane, sqrt(.5^2 + .5^2)
+    .8661f,  // kCube, sqrt(3 * .5^2)
+    .5f,     // kSphere
+    1.119f,  // kCylinder, sqrt(.5^2 + 1^2)
+    .5f};    // kTorus, .4 + .1
+
+// Projected radius thresholds, as a ratio of viewport half height, below which
+// coarser levels of detail are selected.
+const float kLodSizes[Shapes::kLodCount - 1] = {.04f, .015f};
+
+// Per transform format pipeline variant.
+Shapes::Variant VariantOf(const HMM_Mat4*) { return Shapes::kMatrix; }
+Shapes::Variant VariantOf(const Affine*) { return Shapes::kAffine; }
+Shapes::Variant VariantOf(const TranslationScale*) {
+  return Shapes::kTranslationScale;
+}
+Shapes::Variant VariantOf(const TranslationRotationScale*) {
+  return Shapes::kTranslationRotationScale;
+}
+
+// World space bounding sphere of a transformed shape, from its local radius.
+HMM_Vec4 Bounds(const HMM_Mat4& _transform, float _radius) {
+  const float scale2 = std::max({HMM_LenSqr(_transform.Columns[0].XYZ),
+                                 HMM_LenSqr(_transform.Columns[1].XYZ),
+                                 HMM_LenSqr(_transform.Columns[2].XYZ)});
+  return HMM_V4V(_transform.Columns[3].XYZ, _radius * std::sqrt(scale2));
+}
+HMM_Vec4 Bounds(const Affine& _transform, float _radius) {
+  const auto& r = _transform.rows;
+  float scale2 = 0;
+  for (int c = 0; c < 3; ++c) {
+    scale2 = std::max(scale2, r[0][c] * r[0][c] + r[1][c] * r[1][c] +
+                                  r[2][c] * r[2][c]);
+  }
+  return {r[0].W, r[1].W, r[2].W, _radius * std::sqrt(scale2)};
+}
+HMM_Vec4 Bounds(const TranslationScale& _transform, float _radius) {
+  return HMM_V4V(_transform.translation, _radius * std::abs(_transform.scale));
+}
+HMM_Vec4 Bounds(const TranslationRotationScale& _transform, float _radius) {
+  return HMM_V4V(_transform.translation, _radius * std::abs(_transform.scale));
+}
+
+// Reuses a byte buffer as an array of _count _Ty.
+template <typename _Ty>
+std::span<_Ty> Scratch(std::vector<std::byte>& _buffer, size_t _count) {
+  _buffer.resize(_count * sizeof(_Ty));
+  return {reinterpret_cast<_Ty*>(_buffer.data()), _count};
+}
+}  // namespace
+
+template <typename _Transform>
+bool RendererImpl::DrawShapesImpl(std::span<const _Transform> _transforms,
+                                  std::span<const Color> _colors, Shape _shape,
+                                  Color _color) {
+  assert(_shape >= Shape::kPlane && _shape < Shape::kCount);
+  assert(_colors.empty() || _colors.size() == _transforms.size());
+  FLIP_PROFILE("DrawShapes");
+
+  // Batched ImDraw scopes are rendered first, preserving draw order.
+  FlushImDraw();
+
+  auto& res = *resources_;
+  auto gpu_scope = GpuTimers::Scope(res.gpu_timers, GpuTimers::kShapes);
+  const bool colored = !_colors.empty();
+  const auto variant =
+      colored ? Shapes::kMatrixColor : VariantOf(_transforms.data());
+  res.culling_stats.instances += _transforms.size();
+
+  if (!res.culling_enabled) {
+    // Updates model space transforms and colors buffers
+    auto models_binding =
+        res.transforms_buffer.Append(std::as_bytes(_transforms));
+    auto colors_binding = colored
+                              ? res.colors_buffer.Append(std::as_bytes(_colors))
+                              : BufferBinding{};
+
+    // Draw, using finest level of detail
+    res.culling_stats.lods[0] += _transforms.size();
+    return res.shapes.Draw(variant, _shape, 0, _color, _transforms.size(),
+                           models_binding, colors_binding, view_proj_);
+  }
+
+  // Classifies instances bounding spheres.
+  const auto count = _transforms.size();
+  auto spheres = Scratch<HMM_Vec4>(res.culling_spheres, count);
+  auto lods = Scratch<int8_t>(res.culling_lods, count);
+  const float radius = kShapeRadius[_shape];
+  for (size_t i = 0; i < count; ++i) {
+    spheres[i] = Bounds(_transforms[i], radius);
+  }
+  res.culling.Classify(spheres, kLodSizes, lods);
+
+  // Sorts visible instances by level of detail (counting sort), so each level
+  // is a contiguous range.
+  int offsets[Shapes::kLodCount + 1] = {};
+  for (auto lod : lods) {
+    offsets[lod + 1] += lod >= 0;
+  }
+  for (int lod = 0; lod < Shapes::kLodCount; ++lod) {
+    res.culling_stats.lods[lod] += offsets[lod + 1];
+    offsets[lod + 1] += offsets[lod];
+  }
+  const int visibles = offsets[Shapes::kLodCount];
+  if (visibles == 0) {
+    return true;
+  }
+
+  auto sorted = Scratch<_Transform>(res.culling_transforms, visibles);
+  auto sorted_colors =
+      Scratch<Color>(res.culling_colors, colored ? visibles : 0);
+  int cursors[Shapes::kLodCount];
+  std::copy_n(offsets, Shapes::kLodCount, cursors);
+  for (size_t i = 0; i < count; ++i) {
+    const int lod = lods[i];
+    if (lod < 0) {
+      continue;
+    }
+    const int index = cursors[lod]++;
+    sorted[index] = _transforms[i];
+    if (colored) {
+      sorted_colors[index] = _colors[i];
+    }
+  }
+
+  // Updates model space transforms and colors buffers once for all levels.
+  auto models_binding = res.transforms_buffer.Append(std::as_bytes(sorted));
+  auto colors_binding =
+      colored ? res.colors_buffer.Append(std::as_bytes(sorted_colors))
+              : BufferBinding{};
+
+  // Draws each level of detail.
+  bool success = true;
+  for (int lod = 0; lod < Shapes::kLodCount; ++lod) {
+    const int first = offsets[lod];
+    const int instances = offsets[lod + 1] - first;
+    if (instances == 0) {
+      continue;
+    }
+    const auto models = BufferBinding{
+        .id = models_binding.id,
+        .offset = models_binding.offset +
+                  first * static_cast<int>(sizeof(_Transform))};
+    const auto colors = BufferBinding{
+        .id = colors_binding.id,
+        .offset = colors_binding.offset +
+                  first * static_cast<int>(sizeof(Color))};
+    success &= res.shapes.Draw(variant, _shape, lod, _color, instances, models,
+                               colors, view_proj_);
+  }
+  return success;
+}
+
 bool RendererImpl::DrawShapes(std::span<const HMM_Mat4> _transforms,
                               Shape _shape, Color _color) {
-  assert(_shape >= Shape::kPlane && _shape < Shape::kCount);
+  return DrawShapesImpl(_transforms, {}, _shape, _color);
+}
 
-  // Updates model space matrices buffer
-  auto buffer_binding = resources_->transforms_buffer.Append(
-      std::as_bytes(std::span{_transforms}));
+bool RendererImpl::DrawShapes(std::span<const Affine> _transforms,
+                              Shape _shape, Color _color) {
+  return DrawShapesImpl(_transforms, {}, _shape, _color);
+}
 
-  // Draw
-  return resources_->shapes.Draw(_shape, _color, _transforms.size(),
-                                 buffer_binding, view_proj_);
+bool RendererImpl::DrawShapes(std::span<const TranslationScale> _transforms,
+                              Shape _shape, Color _color) {
+  return DrawShapesImpl(_transforms, {}, _shape, _color);
 }
 
-bool RendererImpl::DrawAxes(std::span<const HMM_Mat4> _transforms) {
-  for (auto& transform : _transforms) {
-    auto drawer =
-        flip::ImDraw{*this, transform, {.type = SG_PRIMITIVETYPE_LINES}};
+bool RendererImpl::DrawShapes(
+    std::span<const TranslationRotationScale> _transforms, Shape _shape,
+    Color _color) {
+  return DrawShapesImpl(_transforms, {}, _shape, _color);
+}
 
-    drawer.color(1, 0, 0, 1);
-    drawer.vertex(0, 0, 0);
-    drawer.vertex(1, 0, 0);
+bool RendererImpl::DrawShapes(std::span<const HMM_Mat4> _transforms,
+                              std::span<const Color> _colors, Shape _shape) {
+  assert(_transforms.size() == _colors.size());
+  const auto instances = std::min(_transforms.size(), _colors.size());
+  return DrawShapesImpl(_transforms.first(instances),
+                        _colors.first(instances), _shape, kWhite);
+}
 
-    drawer.color(0, 1, 0, 1);
-    drawer.vertex(0, 0, 0);
-    drawer.vertex(0, 1, 0);
+Renderer::Instances RendererImpl::CreateInstances(
+    std::span<const HMM_Mat4> _transforms) {
+  if (_transforms.empty()) {
+    return {};
+  }
 
-    drawer.color(0, 0, 1, 1);
-    drawer.vertex(0, 0, 0);
-    drawer.vertex(0, 0, 1);
+  // Finds a free slot or allocates a new one.
+  auto& retained = resources_->retained;
+  auto it = std::find_if(retained.begin(), retained.end(), [](auto& _r) {
+    return !_r.buffer.is_valid();
+  });
+  if (it == retained.end()) {
+    assert(retained.size() < Resources::kSlotMask && "Too many instances.");
+    it = retained.emplace(retained.end());
   }
+
+  it->buffer = MakeSgBuffer(
+      sg_buffer_desc{.size = _transforms.size_bytes(),
+                     .usage = SG_USAGE_DYNAMIC,
+                     .label = "flip: retained instances"});
+  it->transforms.assign(_transforms.begin(), _transforms.end());
+  it->dirty = true;
+  it->update_frame = ~uint64_t{0};
+
+  const auto slot = static_cast<uint32_t>(it - retained.begin());
+  return {(it->version << Resources::kSlotBits) | (slot + 1)};
+}
+
+void RendererImpl::DestroyInstances(Instances _instances) {
+  auto* instances = resources_->FindRetained(_instances);
+  if (instances) {
+    const auto version =
+        (instances->version + 1) & (~0u >> Resources::kSlotBits);
+    *instances = {.version = version};
+  }
+}
+
+bool RendererImpl::UpdateInstances(Instances _instances, size_t _first,
+                                   std::span<const HMM_Mat4> _transforms) {
+  auto* instances = resources_->FindRetained(_instances);
+  if (!instances ||
+      _first + _transforms.size() > instances->transforms.size()) {
+    return false;
+  }
+  std::copy(_transforms.begin(), _transforms.end(),
+            instances->transforms.begin() + _first);
+  instances->dirty |= !_transforms.empty();
   return true;
 }
 
-bool RendererImpl::DrawGrids(std::span<const HMM_Mat4> _transforms,
-                             int _cells) {
-  const float kCellSize = 1.f;
-  const float extent = _cells * kCellSize;
-  const auto corner = HMM_Vec3{-extent, 0, -extent} * .5f;
+bool RendererImpl::DrawShapes(Instances _instances, Shape _shape,
+                              Color _color) {
+  assert(_shape >= Shape::kPlane && _shape < Shape::kCount);
 
-  // Alpha blended surface
-  {
-    for (auto& transform : _transforms) {
-      auto drawer = ImDraw{*this,
-                           transform,
-                           {.type = SG_PRIMITIVETYPE_TRIANGLE_STRIP,
-                            .z_write = false,
-                            .cull_mode = SG_CULLMODE_NONE,
-                            .alpha_blending = true}};
-
-      drawer.color(.5f, .7f, .8f, .6f);
-      drawer.vertex(corner.X, corner.Y, corner.Z);
-      drawer.vertex(corner.X, corner.Y, corner.Z + extent);
-      drawer.vertex(corner.X + extent, corner.Y, corner.Z);
-      drawer.vertex(corner.X + extent, corner.Y, corner.Z + extent);
-    }
+  auto* instances = resources_->FindRetained(_instances);
+  if (!instances) {
+    return false;
+  }
+  FlushImDraw();
+  auto gpu_scope = GpuTimers::Scope(resources_->gpu_timers, GpuTimers::kShapes);
+
+  // Dynamic buffers can only be updated once per frame, following updates
+  // are postponed to the next frame.
+  if (instances->dirty && instances->update_frame != frame_) {
+    sg_update_buffer(instances->buffer.id(),
+                     sg_range{.ptr = instances->transforms.data(),
+                              .size = instances->transforms.size() *
+                                      sizeof(HMM_Mat4)});
+    instances->dirty = false;
+    instances->update_frame = frame_;
   }
 
-  // Opaque grid lines
-  {
-    for (auto& transform : _transforms) {
-      auto drawer = ImDraw{
-          *this, transform, {.type = SG_PRIMITIVETYPE_LINES, .z_write = false}};
-
-      drawer.color(.9f, .9f, .9f, 1.f);
-
-      // Renders lines along X axis.
-      auto begin = corner, end = corner;
-      end.X += extent;
-      for (int i = 0; i < _cells + 1; ++i) {
-        drawer.vertex(begin.X, begin.Y, begin.Z);
-        drawer.vertex(end.X, end.Y, end.Z);
-        begin.Z += kCellSize;
-        end.Z += kCellSize;
-      }
-      // Renders lines along Z axis.
-      begin = end = corner;
-      end.Z += extent;
-      for (int i = 0; i < _cells + 1; ++i) {
-        drawer.vertex(begin.X, begin.Y, begin.Z);
-        drawer.vertex(end.X, end.Y, end.Z);
-        begin.X += kCellSize;
-        end.X += kCellSize;
-      }
-    }
+  const auto count = instances->transforms.size();
+  resources_->culling_stats.instances += count;
+  resources_->culling_stats.lods[0] += count;
+  return resources_->shapes.Draw(
+      Shapes::kMatrix, _shape, 0, _color, count,
+      BufferBinding{.id = instances->buffer.id(), .offset = 0}, {},
+      view_proj_);
+}
+
+bool RendererImpl::DrawAxes(std::span<const HMM_Mat4> _transforms) {
+  if (_transforms.empty()) {
+    return true;
   }
-  return true;
+  FlushImDraw();
+
+  auto gpu_scope = GpuTimers::Scope(resources_->gpu_timers, GpuTimers::kGizmos);
+
+  // Updates model space matrices buffer
+  auto buffer_binding = resources_->transforms_buffer.Append(
+      std::as_bytes(std::span{_transforms}));
+
+  // Draw
+  return resources_->gizmos.DrawAxes(_transforms.size(), buffer_binding,
+                                     view_proj_);
+}
+
+bool RendererImpl::DrawGrids(std::span<const HMM_Mat4> _transforms,
+                             int _cells) {
+  if (_transforms.empty() || _cells <= 0) {
+    return true;
+  }
+  FlushImDraw();
+
+  auto gpu_scope = GpuTimers::Scope(resources_->gpu_timers, GpuTimers::kGizmos);
+
+  // Updates model space matrices buffer
+  auto buffer_binding = resources_->transforms_buffer.Append(
+      std::as_bytes(std::span{_transforms}));
+
+  // Draw
+  return resources_->gizmos.DrawGrids(_cells, _transforms.size(),
+                                      buffer_binding, view_proj_);
 }
 }  // namespace flip
\ No newline at end of file
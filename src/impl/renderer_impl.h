@@ -9,7 +9,7 @@ struct CameraView;
 // Base Renderer interface
 class RendererImpl : public Renderer {
  public:
-  RendererImpl();
+  explicit RendererImpl(bool _offscreen = false);
   virtual ~RendererImpl();
 
  protected:
@@ -18,12 +18,36 @@ class RendererImpl : public Renderer {
 
   virtual bool DrawShapes(std::span<const HMM_Mat4> _transforms, Shape _shape,
                           Color _color) override;
+  virtual bool DrawShapes(std::span<const Affine> _transforms, Shape _shape,
+                          Color _color) override;
+  virtual bool DrawShapes(std::span<const TranslationScale> _transforms,
+                          Shape _shape, Color _color) override;
+  virtual bool DrawShapes(std::span<const TranslationRotationScale> _transforms,
+                          Shape _shape, Color _color) override;
+  virtual bool DrawShapes(std::span<const HMM_Mat4> _transforms,
+                          std::span<const Color> _colors,
+                          Shape _shape) override;
+  virtual Instances CreateInstances(
+      std::span<const HMM_Mat4> _transforms) override;
+  virtual void DestroyInstances(Instances _instances) override;
+  virtual bool UpdateInstances(Instances _instances, size_t _first,
+                               std::span<const HMM_Mat4> _transforms) override;
+  virtual bool DrawShapes(Instances _instances, Shape _shape,
+                          Color _color) override;
   virtual bool DrawAxes(std::span<const HMM_Mat4> _transforms) override;
   virtual bool DrawGrids(std::span<const HMM_Mat4> _transforms,
                          int _cells) override;
 
+  virtual void Submit(const CommandList& _list) override;
+
   virtual const HMM_Mat4& GetViewProj() const override { return view_proj_; }
 
+  virtual void WarmUpImModes(std::span<const ImMode> _modes) override;
+  virtual int GetLatePipelines() const override;
+
+  virtual void BatchImDraw(bool _batch) override;
+  virtual void FlushImDraw() override;
+
  private:
   virtual void BeginDefaultPass(const CameraView& _view) override;
   virtual void EndDefaultPass() override;
@@ -32,6 +56,15 @@ class RendererImpl : public Renderer {
                            const ImMode& _mode) override;
   virtual void EndImDraw(std::span<const ImVertex> _vertices, sg_image _image,
                          sg_sampler _sampler) override;
+  virtual std::span<ImVertex> ReallocateImVertices(
+      std::span<ImVertex> _vertices, size_t _count) override;
+
+  // Culls, selects level of detail and renders shapes of any transform format.
+  // _colors is either empty or of the same size as _transforms.
+  template <typename _Transform>
+  bool DrawShapesImpl(std::span<const _Transform> _transforms,
+                      std::span<const Color> _colors, Shape _shape,
+                      Color _color);
 
   // Declares a resource container:
   // - Prevents from including sokol here and messing the header.
@@ -41,6 +74,9 @@ class RendererImpl : public Renderer {
 
   // View projection matrix
   HMM_Mat4 view_proj_;
+
+  // Number of frames rendered.
+  uint64_t frame_ = 0;
 };
 
 }  // namespace flip
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "shapes.h"
 
 #include <cassert>
+#include <string>
 #include <vector>
 
 // Sokol library, do not sort includes
@@ -17,21 +18,80 @@ struct Uniforms {
   Color color;
 };
 
+static_assert(sizeof(Affine) == 48);
+static_assert(sizeof(TranslationScale) == 16);
+static_assert(sizeof(TranslationRotationScale) == 32);
+
+namespace {
+// Describes per instance data layout of each variant. All instance attributes
+// are float4, packed consecutively.
+struct VariantDesc {
+  const char* defines;
+  int stride;
+  int attributes;
+  bool colored;
+};
+const VariantDesc kVariants[Shapes::kVariantCount] = {
+    {"", sizeof(HMM_Mat4), 4, false},
+    {"#define INSTANCE_COLOR\n", sizeof(HMM_Mat4), 4, true},
+    {"#define INSTANCE_AFFINE\n", sizeof(Affine), 3, false},
+    {"#define INSTANCE_TS\n", sizeof(TranslationScale), 1, false},
+    {"#define INSTANCE_TRS\n", sizeof(TranslationRotationScale), 2, false}};
+}  // namespace
+
 void Shapes::Initialize() {
   bool success = true;
 
-  // Create shader
-  auto shader_desc = sg_shader_desc{.label = "flip: Shapes"};
-  shader_desc.vs.source = VS_VERSION
+  // Create shaders, one per instance data variant. instance_model() rebuilds
+  // model matrix from per instance attributes.
+  const char* vs_source =
       "uniform mat4 vp;\n"
       "uniform vec4 color;\n"
       "layout(location=0) in vec4 position;\n"
       "layout(location=1) in vec3 normal;\n"
       "layout(location=2) in vec2 texcoord;\n"
-      "layout(location=3) in mat4 model;\n"
+      "#if defined(INSTANCE_AFFINE)\n"
+      "layout(location=3) in vec4 model_row0;\n"
+      "layout(location=4) in vec4 model_row1;\n"
+      "layout(location=5) in vec4 model_row2;\n"
+      "mat4 instance_model() {\n"
+      "  return transpose(\n"
+      "    mat4(model_row0, model_row1, model_row2, vec4(0., 0., 0., 1.)));\n"
+      "}\n"
+      "#elif defined(INSTANCE_TS)\n"
+      "layout(location=3) in vec4 translation_scale;\n"
+      "mat4 instance_model() {\n"
+      "  float s = translation_scale.w;\n"
+      "  return mat4(vec4(s, 0., 0., 0.), vec4(0., s, 0., 0.),\n"
+      "    vec4(0., 0., s, 0.), vec4(translation_scale.xyz, 1.));\n"
+      "}\n"
+      "#elif defined(INSTANCE_TRS)\n"
+      "layout(location=3) in vec4 translation_scale;\n"
+      "layout(location=4) in vec4 rotation;\n"
+      "mat4 instance_model() {\n"
+      "  vec4 q = rotation;\n"
+      "  vec3 q2 = q.xyz * 2.;\n"
+      "  vec3 c0 = vec3(1. - q2.y * q.y - q2.z * q.z,\n"
+      "    q2.x * q.y + q2.z * q.w, q2.x * q.z - q2.y * q.w);\n"
+      "  vec3 c1 = vec3(q2.x * q.y - q2.z * q.w,\n"
+      "    1. - q2.x * q.x - q2.z * q.z, q2.y * q.z + q2.x * q.w);\n"
+      "  vec3 c2 = vec3(q2.x * q.z + q2.y * q.w,\n"
+      "    q2.y * q.z - q2.x * q.w, 1. - q2.x * q.x - q2.y * q.y);\n"
+      "  float s = translation_scale.w;\n"
+      "  return mat4(vec4(c0 * s, 0.), vec4(c1 * s, 0.), vec4(c2 * s, 0.),\n"
+      "    vec4(translation_scale.xyz, 1.));\n"
+      "}\n"
+      "#else\n"
+      "layout(location=3) in mat4 model_matrix;\n"
+      "mat4 instance_model() { return model_matrix; }\n"
+      "#endif\n"
+      "#ifdef INSTANCE_COLOR\n"
+      "layout(location=7) in vec4 instance_color;\n"
+      "#endif\n"
       "out vec3 vertex_normal;\n"
       "out vec4 vertex_color;\n"
       "void main() {\n"
+      "  mat4 model = instance_model();\n"
       "  gl_Position = vp * model * position;\n"
       "  mat3 cross_matrix = mat3(\n"
       "    cross(model[1].xyz, model[2].xyz),\n"
@@ -40,8 +100,13 @@ void Shapes::Initialize() {
       "  float invdet = 1.0 / dot(cross_matrix[2], model[2].xyz);\n"
       "  mat3 normal_matrix = cross_matrix * invdet;\n"
       "  vertex_normal = normal_matrix * normal;\n"
+      "#ifdef INSTANCE_COLOR\n"
+      "  vertex_color = color * instance_color;\n"
+      "#else\n"
       "  vertex_color = color;\n"
+      "#endif\n"
       "}\n";
+  auto shader_desc = sg_shader_desc{.label = "flip: Shapes"};
   shader_desc.vs.uniform_blocks[0] = {
       .size = sizeof(Uniforms),
       .uniforms = {{.name = "vp", .type = SG_UNIFORMTYPE_MAT4},
@@ -58,36 +123,44 @@ void Shapes::Initialize() {
       "alpha.y);\n"
       "  frag_color = vertex_color * vec4(ambient, 1.);\n"
       "}\n";
-  shader_ = MakeSgShader(shader_desc);
-
-  // Shader and pipeline object
-  pipeline_ = MakeSgPipeline(sg_pipeline_desc{
-      .shader = shader_.id(),
-      .layout = {.buffers = {sshape_vertex_buffer_layout_state(),
-                             {.stride = sizeof(HMM_Mat4),
-                              .step_func = SG_VERTEXSTEP_PER_INSTANCE}},
-                 .attrs =
-                     {
-                         sshape_position_vertex_attr_state(),
-                         sshape_normal_vertex_attr_state(),
-                         sshape_texcoord_vertex_attr_state(),
-                         sg_vertex_attr_state{.buffer_index = 1,
-                                              .offset = 0,
-                                              .format = SG_VERTEXFORMAT_FLOAT4},
-                         sg_vertex_attr_state{.buffer_index = 1,
-                                              .offset = 16,
-                                              .format = SG_VERTEXFORMAT_FLOAT4},
-                         sg_vertex_attr_state{.buffer_index = 1,
-                                              .offset = 32,
-                                              .format = SG_VERTEXFORMAT_FLOAT4},
-                         sg_vertex_attr_state{.buffer_index = 1,
-                                              .offset = 48,
-                                              .format = SG_VERTEXFORMAT_FLOAT4},
-                     }},
-      .depth = {.compare = SG_COMPAREFUNC_LESS_EQUAL, .write_enabled = true},
-      .index_type = SG_INDEXTYPE_UINT16,
-      .cull_mode = SG_CULLMODE_BACK,
-      .label = "flip: Shapes"});
+
+  for (int i = 0; i < kVariantCount; ++i) {
+    const auto& variant = kVariants[i];
+    const auto source = std::string(VS_VERSION) + variant.defines + vs_source;
+    shader_desc.vs.source = source.c_str();
+    shaders_[i] = MakeSgShader(shader_desc);
+
+    // Shader and pipeline object
+    auto pipeline_desc = sg_pipeline_desc{
+        .shader = shaders_[i].id(),
+        .layout = {.buffers = {sshape_vertex_buffer_layout_state(),
+                               {.stride = variant.stride,
+                                .step_func = SG_VERTEXSTEP_PER_INSTANCE}},
+                   .attrs =
+                       {
+                           sshape_position_vertex_attr_state(),
+                           sshape_normal_vertex_attr_state(),
+                           sshape_texcoord_vertex_attr_state(),
+                       }},
+        .depth = {.compare = SG_COMPAREFUNC_LESS_EQUAL, .write_enabled = true},
+        .index_type = SG_INDEXTYPE_UINT16,
+        .cull_mode = SG_CULLMODE_BACK,
+        .label = "flip: Shapes"};
+    for (int a = 0; a < variant.attributes; ++a) {
+      pipeline_desc.layout.attrs[3 + a] = {.buffer_index = 1,
+                                           .offset = a * 16,
+                                           .format = SG_VERTEXFORMAT_FLOAT4};
+    }
+    if (variant.colored) {
+      // Colors are a second per instance stream.
+      pipeline_desc.layout.buffers[2] = {
+          .stride = sizeof(Color), .step_func = SG_VERTEXSTEP_PER_INSTANCE};
+      pipeline_desc.layout.attrs[7] = {.buffer_index = 2,
+                                       .offset = 0,
+                                       .format = SG_VERTEXFORMAT_FLOAT4};
+    }
+    pipelines_[i] = MakeSgPipeline(pipeline_desc);
+  }
 
   // Generate shape geometries
   auto vertices = std::vector<sshape_vertex_t>(4 << 10);
@@ -106,42 +179,48 @@ void Shapes::Initialize() {
     return {_sdraw.base_element, _sdraw.num_elements};
   };
   buf = sshape_build_box(&buf, &box);
-  draws_[Renderer::Shape::kCube] = to_range(sshape_element_range(&buf));
+  draws_[Renderer::Shape::kCube].fill(to_range(sshape_element_range(&buf)));
   assert(buf.valid);
 
   const auto plane = sshape_plane_t{.width = 1.f, .depth = 1.f, .tiles = 1};
   buf = sshape_build_plane(&buf, &plane);
-  draws_[Renderer::Shape::kPlane] = to_range(sshape_element_range(&buf));
+  draws_[Renderer::Shape::kPlane].fill(to_range(sshape_element_range(&buf)));
   assert(buf.valid);
 
-  const auto sphere = sshape_sphere_t{
-      .radius = .5f,
-      .slices = 24,
-      .stacks = 12,
-  };
-  buf = sshape_build_sphere(&buf, &sphere);
-  draws_[Renderer::Shape::kSphere] = to_range(sshape_element_range(&buf));
-  assert(buf.valid);
+  // Rounded shapes tessellation is halved for each level of detail.
+  for (int lod = 0; lod < kLodCount; ++lod) {
+    const auto sphere = sshape_sphere_t{
+        .radius = .5f,
+        .slices = static_cast<uint16_t>(24 >> lod),
+        .stacks = static_cast<uint16_t>(12 >> lod),
+    };
+    buf = sshape_build_sphere(&buf, &sphere);
+    draws_[Renderer::Shape::kSphere][lod] =
+        to_range(sshape_element_range(&buf));
+    assert(buf.valid);
 
-  const auto cylinder = sshape_cylinder_t{
-      .radius = .5f,
-      .height = 1.f,
-      .slices = 24,
-      .stacks = 1,
-  };
-  buf = sshape_build_cylinder(&buf, &cylinder);
-  draws_[Renderer::Shape::kCylinder] = to_range(sshape_element_range(&buf));
-  assert(buf.valid);
+    const auto cylinder = sshape_cylinder_t{
+        .radius = .5f,
+        .height = 1.f,
+        .slices = static_cast<uint16_t>(24 >> lod),
+        .stacks = 1,
+    };
+    buf = sshape_build_cylinder(&buf, &cylinder);
+    draws_[Renderer::Shape::kCylinder][lod] =
+        to_range(sshape_element_range(&buf));
+    assert(buf.valid);
 
-  const auto torus = sshape_torus_t{
-      .radius = .4f,
-      .ring_radius = .1f,
-      .sides = 12,
-      .rings = 24,
-  };
-  buf = sshape_build_torus(&buf, &torus);
-  draws_[Renderer::Shape::kTorus] = to_range(sshape_element_range(&buf));
-  assert(buf.valid);
+    const auto torus = sshape_torus_t{
+        .radius = .4f,
+        .ring_radius = .1f,
+        .sides = static_cast<uint16_t>(12 >> lod),
+        .rings = static_cast<uint16_t>(24 >> lod),
+    };
+    buf = sshape_build_torus(&buf, &torus);
+    draws_[Renderer::Shape::kTorus][lod] =
+        to_range(sshape_element_range(&buf));
+    assert(buf.valid);
+  }
 
   auto vbuf_desc = sshape_vertex_buffer_desc(&buf);
   vbuf_desc.label = "flip: shapes vertex buffer";
@@ -152,21 +231,29 @@ void Shapes::Initialize() {
   index_buffer_ = MakeSgBuffer(ibuf_desc);
 }
 
-bool Shapes::Draw(Renderer::Shape _shape, Color _color, int _intances,
-                  const BufferBinding& _models, HMM_Mat4& _view_proj) {
-  sg_apply_pipeline(pipeline_.id());
+bool Shapes::Draw(Variant _variant, Renderer::Shape _shape, int _lod,
+                  Color _color, int _intances, const BufferBinding& _models,
+                  const BufferBinding& _colors, HMM_Mat4& _view_proj) {
+  assert(_variant < kVariantCount);
+  assert(_lod >= 0 && _lod < kLodCount);
+  sg_apply_pipeline(pipelines_[_variant].id());
 
   auto bindings = sg_bindings{};
   bindings.vertex_buffers[0] = vertex_buffer_.id();
   bindings.vertex_buffers[1] = _models.id;
   bindings.vertex_buffer_offsets[1] = _models.offset;
+  if (kVariants[_variant].colored) {
+    bindings.vertex_buffers[2] = _colors.id;
+    bindings.vertex_buffer_offsets[2] = _colors.offset;
+  }
   bindings.index_buffer = index_buffer_.id();
   sg_apply_bindings(bindings);
 
   const auto uniforms = Uniforms{.vp = _view_proj, .color = _color};
   sg_apply_uniforms(SG_SHADERSTAGE_VS, 0, SG_RANGE(uniforms));
 
-  sg_draw(draws_[_shape].first, draws_[_shape].second, _intances);
+  const auto& draw = draws_[_shape][_lod];
+  sg_draw(draw.first, draw.second, _intances);
   return true;
 }
 
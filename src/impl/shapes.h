@@ -14,20 +14,39 @@ class Shapes {
 
   void Initialize();
 
-  bool Draw(Renderer::Shape _shape, Color _color, int _intances,
-            const BufferBinding& _models, HMM_Mat4& _view_proj);
+  // Pipeline variants, depending on per instance data layout.
+  enum Variant {
+    kMatrix,                    // HMM_Mat4
+    kMatrixColor,               // HMM_Mat4 and Color streams
+    kAffine,                    // Affine
+    kTranslationScale,          // TranslationScale
+    kTranslationRotationScale,  // TranslationRotationScale
+    kVariantCount
+  };
+
+  // Number of levels of detail, from the finest to the coarsest. Only
+  // rounded shapes have distinct geometries per level.
+  static constexpr int kLodCount = 3;
+
+  // _colors binding is only used by colored variants.
+  bool Draw(Variant _variant, Renderer::Shape _shape, int _lod, Color _color,
+            int _intances, const BufferBinding& _models,
+            const BufferBinding& _colors, HMM_Mat4& _view_proj);
 
  protected:
  private:
-  SgShader shader_;
-  SgPipeline pipeline_;
+  // Shaders and pipelines for each variant.
+  SgShader shaders_[kVariantCount];
+  SgPipeline pipelines_[kVariantCount];
 
   // One vertex/index-buffer-pair for all shapes
   SgBuffer vertex_buffer_;
   SgBuffer index_buffer_;
 
-  // Pairs of base offset and num elements.
-  std::array<std::pair<int, int>, Renderer::Shape::kCount> draws_;
+  // Pairs of base offset and num elements, per shape and level of detail.
+  std::array<std::array<std::pair<int, int>, kLodCount>,
+             Renderer::Shape::kCount>
+      draws_;
 };
 
 }  // namespace flip
\ No newline at end of file
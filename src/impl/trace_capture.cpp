@@ -0,0 +1,95 @@
+#include "trace_capture.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "sokol/sokol_time.h"
+
+namespace flip {
+
+TraceCapture::TraceCapture(const char* _path, int _frames)
+    : path_{_path}, frames_{_frames} {
+  assert(_frames > 0);
+}
+
+namespace {
+void WriteString(std::FILE* _file, const char* _string) {
+  std::fputc('"', _file);
+  for (const char* c = _string; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      std::fputc('\\', _file);
+    }
+    std::fputc(*c, _file);
+  }
+  std::fputc('"', _file);
+}
+}  // namespace
+
+bool TraceCapture::Record(std::span<const ProfileThread> _threads,
+                          uint64_t _begin, uint64_t _end) {
+  if (recorded_ < frames_ && !_threads.empty()) {
+    const auto main = _threads.front().id;
+    events_.push_back({{"Frame", _begin}, main});
+    for (const auto& thread : _threads) {
+      for (const auto& event : thread.events) {
+        events_.push_back({event, thread.id});
+      }
+      if (!thread.events.empty() &&
+          std::none_of(threads_.begin(), threads_.end(),
+                       [&](const auto& _t) { return _t.first == thread.id; })) {
+        threads_.emplace_back(thread.id, thread.name);
+      }
+    }
+    events_.push_back({{nullptr, _end}, main});
+    if (std::none_of(threads_.begin(), threads_.end(),
+                     [main](const auto& _t) { return _t.first == main; })) {
+      threads_.emplace_back(main, _threads.front().name);
+    }
+    ++recorded_;
+  }
+  return recorded_ == frames_;
+}
+
+bool TraceCapture::Write() const {
+  std::FILE* file = std::fopen(path_.c_str(), "w");
+  if (!file) {
+    return false;
+  }
+
+  // Threads are named with metadata events.
+  std::fprintf(file, "{\"traceEvents\":[\n");
+  for (const auto& [id, name] : threads_) {
+    std::fprintf(file,
+                 "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,"
+                 "\"tid\":%u,\"args\":{\"name\":",
+                 id);
+    WriteString(file, name);
+    std::fprintf(file, "}},\n");
+  }
+
+  // Begin/end events map to "B"/"E" trace events, with timestamps in us
+  // relative to capture start. Events of other threads might have begun
+  // before the first frame. End events don't need a name.
+  uint64_t origin = events_.empty() ? 0 : events_.front().event.time;
+  for (const auto& event : events_) {
+    origin = std::min(origin, event.event.time);
+  }
+  for (size_t i = 0; i < events_.size(); ++i) {
+    const auto& [event, thread] = events_[i];
+    const double ts = stm_us(event.time - origin);
+    std::fprintf(file, "{\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+                 event.name ? "B" : "E", ts, thread);
+    if (event.name) {
+      std::fprintf(file, ",\"name\":");
+      WriteString(file, event.name);
+    }
+    std::fprintf(file, "}%s\n", i + 1 == events_.size() ? "" : ",");
+  }
+  std::fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+
+  bool success = !std::ferror(file);
+  success &= std::fclose(file) == 0;
+  return success;
+}
+
+}  // namespace flip
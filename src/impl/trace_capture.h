@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "flip/utils/profile.h"
+
+namespace flip {
+
+// Captures profiling scopes over a number of frames, and writes them to a
+// Chrome trace-event json file, which can be inspected with Perfetto or
+// chrome://tracing.
+class TraceCapture {
+ public:
+  TraceCapture(const char* _path, int _frames);
+
+  // Records a frame, from _begin to _end ticks, and its scope events of all
+  // threads. Frame scope is added to the first thread. Returns true once all
+  // frames were recorded.
+  bool Record(std::span<const ProfileThread> _threads, uint64_t _begin,
+              uint64_t _end);
+
+  bool Write() const;
+
+  const std::string& path() const { return path_; }
+
+ private:
+  std::string path_;
+  int frames_;
+
+  // Captured events and their thread id, including a "Frame" scope per
+  // frame.
+  struct Event {
+    ProfileEvent event;
+    uint32_t thread;
+  };
+  std::vector<Event> events_;
+  int recorded_ = 0;
+
+  // Names of captured threads, by id.
+  std::vector<std::pair<uint32_t, const char*>> threads_;
+};
+
+}  // namespace flip
@@ -0,0 +1,133 @@
+#include "image_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#include "image_decoder.h"
+
+namespace flip {
+
+namespace {
+// Bumped when the file layout or sokol pixel formats change.
+constexpr uint32_t kMagic = 0x43494C46;  // "FLIC"
+constexpr uint32_t kVersion = 1;
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  int32_t format;
+  int32_t width;
+  int32_t height;
+  int32_t mips;
+  struct {
+    uint64_t offset;
+    uint64_t size;
+  } levels[SG_MAX_MIPMAPS];
+  uint64_t size;
+};
+
+// Largest cached image width or height, as stb's limit.
+constexpr int32_t kMaxSize = 1 << 24;
+}  // namespace
+
+uint64_t HashContent(std::span<const std::byte> _data) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (auto byte : _data) {
+    hash = (hash ^ static_cast<uint64_t>(byte)) * 0x100000001b3;
+  }
+  return hash;
+}
+
+std::string CachedImagePath(const std::string& _dir, uint64_t _hash,
+                            bool _mips) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx%s.flic",
+                static_cast<unsigned long long>(_hash), _mips ? "m" : "");
+  return (std::filesystem::path(_dir) / name).string();
+}
+
+bool LoadCachedImage(const std::string& _path, ImagePayload& _payload) {
+  std::ifstream file(_path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+
+  // Header is validated before allocating anything, as file might be
+  // truncated or corrupted. Only stb decoded RGBA8 images are cached.
+  Header header;
+  std::error_code error;
+  const auto file_size = std::filesystem::file_size(_path, error);
+  if (error || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      header.magic != kMagic || header.version != kVersion ||
+      header.format != SG_PIXELFORMAT_RGBA8 || header.width <= 0 ||
+      header.height <= 0 || header.width > kMaxSize ||
+      header.height > kMaxSize || header.mips < 1 ||
+      header.mips > SG_MAX_MIPMAPS ||
+      header.size != file_size - sizeof(header)) {
+    return false;
+  }
+
+  _payload = {};
+  _payload.format = static_cast<sg_pixel_format>(header.format);
+  _payload.width = header.width;
+  _payload.height = header.height;
+  _payload.mips = header.mips;
+  for (int i = 0; i < header.mips; ++i) {
+    const auto& level = header.levels[i];
+    const auto expected =
+        LevelSize(_payload.format, std::max(_payload.width >> i, 1),
+                  std::max(_payload.height >> i, 1));
+    if (level.size != expected || level.offset > header.size ||
+        level.size > header.size - level.offset) {
+      return false;
+    }
+    _payload.levels[i] = {static_cast<size_t>(level.offset),
+                          static_cast<size_t>(level.size)};
+  }
+  _payload.data.resize(static_cast<size_t>(header.size));
+  return static_cast<bool>(file.read(
+      reinterpret_cast<char*>(_payload.data.data()), header.size));
+}
+
+bool SaveCachedImage(const std::string& _path, const ImagePayload& _payload) {
+  auto header = Header{.magic = kMagic,
+                       .version = kVersion,
+                       .format = _payload.format,
+                       .width = _payload.width,
+                       .height = _payload.height,
+                       .mips = _payload.mips,
+                       .levels = {},
+                       .size = _payload.data.size()};
+  for (int i = 0; i < _payload.mips; ++i) {
+    header.levels[i] = {_payload.levels[i].offset, _payload.levels[i].size};
+  }
+
+  // Temporary file is unique to the writing thread.
+  const auto temp =
+      _path + "." +
+      std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  {
+    std::ofstream file(temp, std::ios::binary);
+    if (!file.write(reinterpret_cast<const char*>(&header), sizeof(header)) ||
+        !file.write(reinterpret_cast<const char*>(_payload.data.data()),
+                    _payload.data.size())) {
+      file.close();
+      std::error_code error;
+      std::filesystem::remove(temp, error);
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temp, _path, error);
+  if (error) {
+    std::filesystem::remove(temp, error);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace flip
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+namespace flip {
+struct ImagePayload;
+
+// 64 bits FNV-1a hash of _data content.
+uint64_t HashContent(std::span<const std::byte> _data);
+
+// Path of the cached payload of a file whose content hash is _hash, decoded
+// with or without _mips.
+std::string CachedImagePath(const std::string& _dir, uint64_t _hash,
+                            bool _mips);
+
+// Reads a payload previously saved to _path. Fails if it doesn't exist or
+// isn't valid.
+bool LoadCachedImage(const std::string& _path, ImagePayload& _payload);
+
+// Saves _payload to _path. File is written to a temporary file first, so
+// concurrent readers never see partial files.
+bool SaveCachedImage(const std::string& _path, const ImagePayload& _payload);
+
+}  // namespace flip
@@ -0,0 +1,405 @@
+#include "image_decoder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include "stb/stb_image.h"
+
+namespace flip {
+
+namespace {
+
+// Little endian reads, bounds must be checked by the caller.
+template <typename _Ty>
+_Ty Read(std::span<const std::byte> _file, size_t _offset) {
+  _Ty value;
+  std::memcpy(&value, _file.data() + _offset, sizeof(_Ty));
+  return value;
+}
+
+constexpr uint32_t FourCC(const char (&_cc)[5]) {
+  return static_cast<uint32_t>(_cc[0]) | static_cast<uint32_t>(_cc[1]) << 8 |
+         static_cast<uint32_t>(_cc[2]) << 16 |
+         static_cast<uint32_t>(_cc[3]) << 24;
+}
+
+}  // namespace
+
+size_t LevelSize(sg_pixel_format _format, int _width, int _height) {
+  size_t block_bytes;
+  switch (_format) {
+    case SG_PIXELFORMAT_RGBA8:
+    case SG_PIXELFORMAT_SRGB8A8:
+      return static_cast<size_t>(_width) * _height * 4;
+    case SG_PIXELFORMAT_BC1_RGBA:
+    case SG_PIXELFORMAT_BC4_R:
+    case SG_PIXELFORMAT_BC4_RSN:
+    case SG_PIXELFORMAT_ETC2_RGB8:
+    case SG_PIXELFORMAT_ETC2_RGB8A1:
+      block_bytes = 8;
+      break;
+    default:
+      block_bytes = 16;
+      break;
+  }
+  return static_cast<size_t>((_width + 3) / 4) * ((_height + 3) / 4) *
+         block_bytes;
+}
+
+namespace {
+
+// Fills _payload levels, which are contiguous from _offset. Returns false if
+// they exceed payload data.
+bool SetupLevels(size_t _offset, ImagePayload& _payload) {
+  for (int i = 0; i < _payload.mips; ++i) {
+    const auto size =
+        LevelSize(_payload.format, std::max(_payload.width >> i, 1),
+                  std::max(_payload.height >> i, 1));
+    _payload.levels[i] = {.offset = _offset, .size = size};
+    _offset += size;
+  }
+  return _offset <= _payload.data.size();
+}
+
+// Vulkan formats, as used by KTX2, supported by sokol.
+sg_pixel_format FromVkFormat(uint32_t _format) {
+  switch (_format) {
+    case 37:  // VK_FORMAT_R8G8B8A8_UNORM
+      return SG_PIXELFORMAT_RGBA8;
+    case 43:  // VK_FORMAT_R8G8B8A8_SRGB
+      return SG_PIXELFORMAT_SRGB8A8;
+    case 131:  // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+    case 133:  // VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+      return SG_PIXELFORMAT_BC1_RGBA;
+    case 135:  // VK_FORMAT_BC2_UNORM_BLOCK
+      return SG_PIXELFORMAT_BC2_RGBA;
+    case 137:  // VK_FORMAT_BC3_UNORM_BLOCK
+      return SG_PIXELFORMAT_BC3_RGBA;
+    case 139:  // VK_FORMAT_BC4_UNORM_BLOCK
+      return SG_PIXELFORMAT_BC4_R;
+    case 140:  // VK_FORMAT_BC4_SNORM_BLOCK
+      return SG_PIXELFORMAT_BC4_RSN;
+    case 141:  // VK_FORMAT_BC5_UNORM_BLOCK
+      return SG_PIXELFORMAT_BC5_RG;
+    case 142:  // VK_FORMAT_BC5_SNORM_BLOCK
+      return SG_PIXELFORMAT_BC5_RGSN;
+    case 143:  // VK_FORMAT_BC6H_UFLOAT_BLOCK
+      return SG_PIXELFORMAT_BC6H_RGBUF;
+    case 144:  // VK_FORMAT_BC6H_SFLOAT_BLOCK
+      return SG_PIXELFORMAT_BC6H_RGBF;
+    case 145:  // VK_FORMAT_BC7_UNORM_BLOCK
+      return SG_PIXELFORMAT_BC7_RGBA;
+    case 147:  // VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK
+      return SG_PIXELFORMAT_ETC2_RGB8;
+    case 149:  // VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK
+      return SG_PIXELFORMAT_ETC2_RGB8A1;
+    case 151:  // VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK
+      return SG_PIXELFORMAT_ETC2_RGBA8;
+    case 155:  // VK_FORMAT_EAC_R11G11_UNORM_BLOCK
+      return SG_PIXELFORMAT_ETC2_RG11;
+    case 156:  // VK_FORMAT_EAC_R11G11_SNORM_BLOCK
+      return SG_PIXELFORMAT_ETC2_RG11SN;
+    case 157:  // VK_FORMAT_ASTC_4x4_UNORM_BLOCK
+      return SG_PIXELFORMAT_ASTC_4x4_RGBA;
+    case 158:  // VK_FORMAT_ASTC_4x4_SRGB_BLOCK
+      return SG_PIXELFORMAT_ASTC_4x4_SRGBA;
+    default:
+      return SG_PIXELFORMAT_NONE;
+  }
+}
+
+// DXGI formats, as used by DDS DX10 extended header, supported by sokol.
+sg_pixel_format FromDxgiFormat(uint32_t _format) {
+  switch (_format) {
+    case 28:  // DXGI_FORMAT_R8G8B8A8_UNORM
+      return SG_PIXELFORMAT_RGBA8;
+    case 29:  // DXGI_FORMAT_R8G8B8A8_UNORM_SRGB
+      return SG_PIXELFORMAT_SRGB8A8;
+    case 71:  // DXGI_FORMAT_BC1_UNORM
+      return SG_PIXELFORMAT_BC1_RGBA;
+    case 74:  // DXGI_FORMAT_BC2_UNORM
+      return SG_PIXELFORMAT_BC2_RGBA;
+    case 77:  // DXGI_FORMAT_BC3_UNORM
+      return SG_PIXELFORMAT_BC3_RGBA;
+    case 80:  // DXGI_FORMAT_BC4_UNORM
+      return SG_PIXELFORMAT_BC4_R;
+    case 81:  // DXGI_FORMAT_BC4_SNORM
+      return SG_PIXELFORMAT_BC4_RSN;
+    case 83:  // DXGI_FORMAT_BC5_UNORM
+      return SG_PIXELFORMAT_BC5_RG;
+    case 84:  // DXGI_FORMAT_BC5_SNORM
+      return SG_PIXELFORMAT_BC5_RGSN;
+    case 95:  // DXGI_FORMAT_BC6H_UF16
+      return SG_PIXELFORMAT_BC6H_RGBUF;
+    case 96:  // DXGI_FORMAT_BC6H_SF16
+      return SG_PIXELFORMAT_BC6H_RGBF;
+    case 98:  // DXGI_FORMAT_BC7_UNORM
+      return SG_PIXELFORMAT_BC7_RGBA;
+    default:
+      return SG_PIXELFORMAT_NONE;
+  }
+}
+
+// KTX2 2D textures, without supercompression.
+bool DecodeKtx2(std::vector<std::byte>&& _file, ImagePayload& _payload) {
+  const auto file = std::span<const std::byte>{_file};
+  const size_t kLevelIndex = 80;
+  if (file.size() < kLevelIndex) {
+    return false;
+  }
+  const auto depth = Read<uint32_t>(file, 28);
+  const auto layers = Read<uint32_t>(file, 32);
+  const auto faces = Read<uint32_t>(file, 36);
+  const auto levels = std::max(Read<uint32_t>(file, 40), 1u);
+  const auto supercompression = Read<uint32_t>(file, 44);
+  if (depth > 1 || layers > 1 || faces != 1 || supercompression != 0 ||
+      levels > SG_MAX_MIPMAPS || file.size() < kLevelIndex + levels * 24) {
+    return false;
+  }
+
+  _payload.format = FromVkFormat(Read<uint32_t>(file, 12));
+  _payload.width = static_cast<int>(Read<uint32_t>(file, 20));
+  _payload.height = static_cast<int>(Read<uint32_t>(file, 24));
+  _payload.mips = static_cast<int>(levels);
+  if (_payload.format == SG_PIXELFORMAT_NONE || _payload.width <= 0 ||
+      _payload.height <= 0) {
+    return false;
+  }
+
+  // Levels aren't necessarily contiguous, they are located by the index.
+  for (int i = 0; i < _payload.mips; ++i) {
+    const auto offset = Read<uint64_t>(file, kLevelIndex + i * 24);
+    const auto size = Read<uint64_t>(file, kLevelIndex + i * 24 + 8);
+    const auto expected =
+        LevelSize(_payload.format, std::max(_payload.width >> i, 1),
+                  std::max(_payload.height >> i, 1));
+    if (size != expected || offset > file.size() ||
+        size > file.size() - offset) {
+      return false;
+    }
+    _payload.levels[i] = {.offset = static_cast<size_t>(offset),
+                          .size = static_cast<size_t>(size)};
+  }
+  _payload.data = std::move(_file);
+  return true;
+}
+
+// DDS 2D textures.
+bool DecodeDds(std::vector<std::byte>&& _file, ImagePayload& _payload) {
+  const auto file = std::span<const std::byte>{_file};
+  const size_t kHeaderEnd = 128, kDx10HeaderEnd = 148;
+  if (file.size() < kHeaderEnd) {
+    return false;
+  }
+  const auto pf_flags = Read<uint32_t>(file, 80);
+  const auto fourcc = Read<uint32_t>(file, 84);
+  const auto caps2 = Read<uint32_t>(file, 112);
+  const uint32_t kAlphaFlag = 0x1, kFourCCFlag = 0x4, kRgbFlag = 0x40,
+                 kCubemapCaps = 0x200, kVolumeCaps = 0x200000;
+  if (caps2 & (kCubemapCaps | kVolumeCaps)) {
+    return false;
+  }
+
+  size_t offset = kHeaderEnd;
+  bool bgra = false, opaque = false;
+  if (pf_flags & kFourCCFlag) {
+    switch (fourcc) {
+      case FourCC("DXT1"):
+        _payload.format = SG_PIXELFORMAT_BC1_RGBA;
+        break;
+      case FourCC("DXT3"):
+        _payload.format = SG_PIXELFORMAT_BC2_RGBA;
+        break;
+      case FourCC("DXT5"):
+        _payload.format = SG_PIXELFORMAT_BC3_RGBA;
+        break;
+      case FourCC("ATI1"):
+      case FourCC("BC4U"):
+        _payload.format = SG_PIXELFORMAT_BC4_R;
+        break;
+      case FourCC("BC4S"):
+        _payload.format = SG_PIXELFORMAT_BC4_RSN;
+        break;
+      case FourCC("ATI2"):
+      case FourCC("BC5U"):
+        _payload.format = SG_PIXELFORMAT_BC5_RG;
+        break;
+      case FourCC("BC5S"):
+        _payload.format = SG_PIXELFORMAT_BC5_RGSN;
+        break;
+      case FourCC("DX10"): {
+        const uint32_t kTexture2D = 3, kCubeFlag = 0x4;
+        if (file.size() < kDx10HeaderEnd ||
+            Read<uint32_t>(file, 132) != kTexture2D ||
+            (Read<uint32_t>(file, 136) & kCubeFlag) ||
+            Read<uint32_t>(file, 140) > 1) {
+          return false;
+        }
+        _payload.format = FromDxgiFormat(Read<uint32_t>(file, 128));
+        offset = kDx10HeaderEnd;
+        break;
+      }
+      default:
+        return false;
+    }
+  } else if ((pf_flags & kRgbFlag) && Read<uint32_t>(file, 88) == 32 &&
+             Read<uint32_t>(file, 96) == 0x0000ff00) {
+    // 32 bits RGBA or BGRA, which is swizzled. Alpha is ignored if alpha flag
+    // isn't set.
+    const auto r_mask = Read<uint32_t>(file, 92);
+    const auto b_mask = Read<uint32_t>(file, 100);
+    bgra = r_mask == 0x00ff0000 && b_mask == 0x000000ff;
+    if (bgra || (r_mask == 0x000000ff && b_mask == 0x00ff0000)) {
+      _payload.format = SG_PIXELFORMAT_RGBA8;
+      opaque = !(pf_flags & kAlphaFlag);
+    }
+  }
+
+  _payload.height = static_cast<int>(Read<uint32_t>(file, 12));
+  _payload.width = static_cast<int>(Read<uint32_t>(file, 16));
+  _payload.mips = static_cast<int>(std::max(Read<uint32_t>(file, 28), 1u));
+  if (_payload.format == SG_PIXELFORMAT_NONE || _payload.width <= 0 ||
+      _payload.height <= 0 || _payload.mips > SG_MAX_MIPMAPS) {
+    return false;
+  }
+  _payload.data = std::move(_file);
+  if (!SetupLevels(offset, _payload)) {
+    return false;
+  }
+
+  // Levels are contiguous, texels are converted at once.
+  if (bgra || opaque) {
+    const auto& last = _payload.levels[_payload.mips - 1];
+    auto* texel = reinterpret_cast<uint8_t*>(_payload.data.data() + offset);
+    auto* end = reinterpret_cast<uint8_t*>(_payload.data.data() +
+                                           last.offset + last.size);
+    for (; texel < end; texel += 4) {
+      if (bgra) {
+        std::swap(texel[0], texel[2]);
+      }
+      if (opaque) {
+        texel[3] = 255;
+      }
+    }
+  }
+  return true;
+}
+
+// Halves _src RGBA8 image size to _dst, averaging 2x2 texels. Last row and
+// column are repeated for odd sizes. Loops are kept simple for the compiler
+// to vectorize them.
+void Downsample(const uint8_t* _src, int _src_width, int _src_height,
+                uint8_t* _dst, int _width, int _height) {
+  const size_t src_pitch = static_cast<size_t>(_src_width) * 4;
+  for (int y = 0; y < _height; ++y) {
+    const uint8_t* row0 = _src + std::min(y * 2, _src_height - 1) * src_pitch;
+    const uint8_t* row1 =
+        _src + std::min(y * 2 + 1, _src_height - 1) * src_pitch;
+    uint8_t* dst = _dst + static_cast<size_t>(y) * _width * 4;
+    if (_src_width == _width * 2) {
+      for (int i = 0; i < _width * 4; ++i) {
+        const int x = (i >> 2) * 8 + (i & 3);
+        dst[i] = static_cast<uint8_t>(
+            (row0[x] + row0[x + 4] + row1[x] + row1[x + 4] + 2) >> 2);
+      }
+    } else {
+      for (int i = 0; i < _width * 4; ++i) {
+        const int x = (i >> 2) * 2, c = i & 3;
+        const int x0 = std::min(x, _src_width - 1) * 4 + c;
+        const int x1 = std::min(x + 1, _src_width - 1) * 4 + c;
+        dst[i] = static_cast<uint8_t>(
+            (row0[x0] + row0[x1] + row1[x0] + row1[x1] + 2) >> 2);
+      }
+    }
+  }
+}
+
+// Any stb supported format, decoded to RGBA8.
+bool DecodeStb(std::span<const std::byte> _file, bool _mips,
+               ImagePayload& _payload) {
+  int width, height, channels;
+  auto pixels = std::unique_ptr<stbi_uc, decltype(&stbi_image_free)>{
+      stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(_file.data()),
+                            static_cast<int>(_file.size_bytes()), &width,
+                            &height, &channels, 4),
+      &stbi_image_free};
+  if (!pixels) {
+    return false;
+  }
+
+  _payload.format = SG_PIXELFORMAT_RGBA8;
+  _payload.width = width;
+  _payload.height = height;
+  _payload.mips = 1;
+  if (_mips) {
+    for (int size = std::max(width, height);
+         size > 1 && _payload.mips < SG_MAX_MIPMAPS; size >>= 1) {
+      ++_payload.mips;
+    }
+  }
+  size_t size = 0;
+  for (int i = 0; i < _payload.mips; ++i) {
+    size += LevelSize(_payload.format, std::max(width >> i, 1),
+                      std::max(height >> i, 1));
+  }
+
+  // stb owns decoded pixels allocation, they are copied to the payload as
+  // they are appended, rather than to zero initialized data. Only mip levels
+  // are initialized, before being downsampled.
+  const auto* begin = reinterpret_cast<const std::byte*>(pixels.get());
+  _payload.data.reserve(size);
+  _payload.data.assign(begin,
+                       begin + LevelSize(_payload.format, width, height));
+  pixels = nullptr;
+  _payload.data.resize(size);
+  SetupLevels(0, _payload);
+
+  // Each level is downsampled from the previous one.
+  for (int i = 1; i < _payload.mips; ++i) {
+    const auto* src = reinterpret_cast<const uint8_t*>(
+        _payload.data.data() + _payload.levels[i - 1].offset);
+    auto* dst = reinterpret_cast<uint8_t*>(_payload.data.data() +
+                                           _payload.levels[i].offset);
+    Downsample(src, std::max(width >> (i - 1), 1),
+               std::max(height >> (i - 1), 1), dst, std::max(width >> i, 1),
+               std::max(height >> i, 1));
+  }
+  return true;
+}
+}  // namespace
+
+namespace {
+bool IsKtx2(std::span<const std::byte> _file) {
+  const uint8_t kKtx2Identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32,
+                                       0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+  return _file.size() >= sizeof(kKtx2Identifier) &&
+         std::memcmp(_file.data(), kKtx2Identifier,
+                     sizeof(kKtx2Identifier)) == 0;
+}
+
+bool IsDds(std::span<const std::byte> _file) {
+  return _file.size() >= 4 && Read<uint32_t>(_file, 0) == FourCC("DDS ");
+}
+}  // namespace
+
+bool IsImageContainer(std::span<const std::byte> _file) {
+  return IsKtx2(_file) || IsDds(_file);
+}
+
+bool DecodeImage(std::vector<std::byte>&& _file, bool _mips,
+                 ImagePayload& _payload) {
+  _payload = {};
+  const auto file = std::span<const std::byte>{_file};
+  if (IsKtx2(file)) {
+    return DecodeKtx2(std::move(_file), _payload);
+  }
+  if (IsDds(file)) {
+    return DecodeDds(std::move(_file), _payload);
+  }
+  return DecodeStb(file, _mips, _payload);
+}
+
+}  // namespace flip
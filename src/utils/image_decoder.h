@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "sokol/sokol_gfx.h"
+
+namespace flip {
+
+// Image ready to be uploaded to the GPU, with its mip chain.
+struct ImagePayload {
+  sg_pixel_format format = SG_PIXELFORMAT_NONE;
+  int width = 0;
+  int height = 0;
+
+  // Levels data, stored in data.
+  struct Level {
+    size_t offset;
+    size_t size;
+  };
+  Level levels[SG_MAX_MIPMAPS] = {};
+  int mips = 0;
+  std::vector<std::byte> data;
+
+  std::span<const std::byte> level(int _mip) const {
+    return std::span{data}.subspan(levels[_mip].offset, levels[_mip].size);
+  }
+};
+
+// Decodes _file to _payload. KTX2 and DDS containers are uploaded as is,
+// including compressed formats and their mip levels. Other formats are
+// decoded to RGBA8 with stb, and a mip chain is generated if _mips is true.
+// _file is moved to _payload when it can be uploaded as is.
+bool DecodeImage(std::vector<std::byte>&& _file, bool _mips,
+                 ImagePayload& _payload);
+
+// Size of a _width x _height level of _format, compressed formats being made
+// of 4x4 blocks.
+size_t LevelSize(sg_pixel_format _format, int _width, int _height);
+
+// Returns true if _file is a KTX2 or DDS container, whose data is uploaded
+// without decoding.
+bool IsImageContainer(std::span<const std::byte> _file);
+
+}  // namespace flip
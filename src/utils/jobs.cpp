@@ -0,0 +1,250 @@
+#include "flip/utils/jobs.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "flip/utils/profile.h"
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define FLIP_NO_THREADS
+#endif
+
+namespace flip {
+
+namespace {
+// Queue of the current thread, for the job system it belongs to.
+thread_local const JobSystem* tls_system = nullptr;
+thread_local int tls_queue = 0;
+}  // namespace
+
+JobGraph::Node JobGraph::Add(std::function<void()> _job) {
+  nodes_.push_back({.job = std::move(_job)});
+  return static_cast<Node>(nodes_.size() - 1);
+}
+
+void JobGraph::Depend(Node _node, Node _dependency) {
+  assert(_node >= 0 && _node < static_cast<Node>(nodes_.size()));
+  assert(_dependency >= 0 && _dependency < static_cast<Node>(nodes_.size()));
+  nodes_[_dependency].dependents.push_back(_node);
+  ++nodes_[_node].dependencies;
+}
+
+JobSystem::JobSystem(int _workers) {
+#ifdef FLIP_NO_THREADS
+  _workers = 0;
+#else
+  if (_workers < 0) {
+    _workers = std::max(static_cast<int>(std::thread::hardware_concurrency()),
+                        1) -
+               1;
+  }
+#endif  // FLIP_NO_THREADS
+
+  for (int i = 0; i < _workers + 1; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  for (int i = 0; i < _workers; ++i) {
+    threads_.emplace_back([this, i]() { WorkerLoop(i + 1); });
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard lock(sleep_mutex_);
+    exit_ = true;
+  }
+  wake_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+
+  // Without workers, pending tasks are left to the destroying thread.
+  while (TryRun(true)) {
+  }
+}
+
+void JobSystem::ParallelFor(size_t _count, size_t _grain,
+                            const std::function<void(size_t, size_t)>& _fn) {
+  if (_count == 0) {
+    return;
+  }
+
+  // Automatic grain targets a few chunks per thread, to balance load.
+  if (_grain == 0) {
+    const size_t chunks = (threads_.size() + 1) * 4;
+    _grain = std::max<size_t>((_count + chunks - 1) / chunks, 1);
+  }
+
+  const auto chunks = static_cast<int>((_count + _grain - 1) / _grain);
+  std::atomic<int> pending = chunks;
+  for (int i = 0; i < chunks; ++i) {
+    const size_t begin = i * _grain;
+    const size_t end = std::min(begin + _grain, _count);
+    Push({.fn = [&_fn, begin, end]() { _fn(begin, end); },
+          .pending = &pending});
+  }
+  Wait(pending);
+}
+
+void JobSystem::Run(const JobGraph& _graph) {
+  const auto& nodes = _graph.nodes_;
+  if (nodes.empty()) {
+    return;
+  }
+
+  // Remaining dependencies of each node, a node is pushed once they're all
+  // completed.
+  std::vector<std::atomic<int>> remaining(nodes.size());
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    remaining[i] = nodes[i].dependencies;
+  }
+
+  std::atomic<int> pending = static_cast<int>(nodes.size());
+  std::function<void(JobGraph::Node)> push = [&](JobGraph::Node _node) {
+    Push({.fn =
+              [&, _node]() {
+                const auto& entry = nodes[_node];
+                if (entry.job) {
+                  entry.job();
+                }
+                for (const auto dependent : entry.dependents) {
+                  if (--remaining[dependent] == 0) {
+                    push(dependent);
+                  }
+                }
+              },
+          .pending = &pending});
+  };
+
+  bool root = false;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (nodes[i].dependencies == 0) {
+      push(static_cast<JobGraph::Node>(i));
+      root = true;
+    }
+  }
+  assert(root && "Job graph has a cycle.");
+  Wait(pending);
+}
+
+void JobSystem::Submit(std::function<void()> _job, Counter& _counter) {
+  ++_counter;
+  Push({.fn = std::move(_job), .pending = &_counter});
+}
+
+void JobSystem::SubmitBackground(std::function<void()> _job,
+                                 Counter& _counter) {
+  if (threads_.empty()) {
+    _job();
+    return;
+  }
+  ++_counter;
+  Push({.fn = std::move(_job), .pending = &_counter}, true);
+}
+
+void JobSystem::Push(Task _task, bool _background) {
+  const int index = tls_system == this ? tls_queue : 0;
+  {
+    auto& queue = _background ? background_ : *queues_[index];
+    std::lock_guard lock(queue.mutex);
+    queue.tasks.push_back(std::move(_task));
+  }
+  ++(_background ? background_queued_ : queued_);
+
+  // Locking ensures a worker can't miss the notification between checking
+  // queued_ and sleeping.
+  { std::lock_guard lock(sleep_mutex_); }
+  wake_.notify_one();
+  if (!_background) {
+    WakeWaiters();
+  }
+}
+
+void JobSystem::WakeWaiters() {
+  if (waiters_ > 0) {
+    { std::lock_guard lock(sleep_mutex_); }
+    waiters_wake_.notify_all();
+  }
+}
+
+bool JobSystem::TryRun(bool _background) {
+  const int own = tls_system == this ? tls_queue : 0;
+  const int count = static_cast<int>(queues_.size());
+
+  Task task;
+  bool found = false;
+  for (int i = 0; i < count && !found; ++i) {
+    // Own queue is popped from the back (most recent, hot in cache), others
+    // are stolen from the front (oldest, likely the biggest).
+    auto& queue = *queues_[(own + i) % count];
+    std::lock_guard lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      continue;
+    }
+    if (i == 0) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    --queued_;
+    found = true;
+  }
+  if (!found && _background) {
+    std::lock_guard lock(background_.mutex);
+    if (!background_.tasks.empty()) {
+      task = std::move(background_.tasks.front());
+      background_.tasks.pop_front();
+      --background_queued_;
+      found = true;
+    }
+  }
+  if (!found) {
+    return false;
+  }
+
+  task.fn();
+
+  // Sequentially consistent with waiters_ increment, so a waiter can't miss
+  // the completion.
+  task.pending->fetch_sub(1);
+  WakeWaiters();
+  return true;
+}
+
+void JobSystem::Wait(const Counter& _counter) {
+  while (_counter.load(std::memory_order_acquire) > 0) {
+    if (TryRun()) {
+      continue;
+    }
+
+    // Sleeps until a task is queued, which could be run, or completed.
+    std::unique_lock lock(sleep_mutex_);
+    ++waiters_;
+    waiters_wake_.wait(lock, [&]() { return _counter == 0 || queued_ > 0; });
+    --waiters_;
+  }
+}
+
+void JobSystem::WorkerLoop(int _queue) {
+  tls_system = this;
+  tls_queue = _queue;
+  set_thread_profile_name("Worker");
+  for (;;) {
+    // Only idle workers run background tasks, not the ones waiting within a
+    // job.
+    if (TryRun(true)) {
+      continue;
+    }
+    std::unique_lock lock(sleep_mutex_);
+    wake_.wait(lock, [this]() {
+      return exit_ || queued_ > 0 || background_queued_ > 0;
+    });
+    if (exit_ && queued_ == 0 && background_queued_ == 0) {
+      return;
+    }
+  }
+}
+
+}  // namespace flip
@@ -1,10 +1,17 @@
 #include "flip/utils/loader.h"
 
 #include <cassert>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <type_traits>
 #include <vector>
 
-#include "stb/stb_image.h"
+#include "flip/utils/jobs.h"
+#include "image_cache.h"
+#include "image_decoder.h"
 
 using namespace std::placeholders;
 
@@ -12,106 +19,399 @@ namespace flip {
 
 namespace {
 
+// Scratch buffer used to stream chunks.
+struct Scratch {
+  std::unique_ptr<std::byte[]> data;
+  size_t size = 0;
+};
+
+// Request record, with its destination and callbacks stored inline. Records
+// are allocated by slabs and recycled once completed.
+struct Request {
+  std::vector<std::byte> buffer;  // Unused when streaming.
+  AsyncBuffer::Completion completion;
+  AsyncBuffer::Transfer transfer;  // Instead of completion, if buffer is moved.
+  AsyncBuffer::Consumer consumer;  // Only when streaming.
+  Scratch scratch;                 // Only when chunked.
+  bool notified = false;           // Completion was notified early.
+  Request* next = nullptr;         // Next free record.
+};
+
+// Pools request records and scratch buffers. Like sokol_fetch, it's only
+// used from the main thread.
+class RequestPool {
+ public:
+  Request& Acquire() {
+    if (!free_) {
+      slabs_.push_back(std::make_unique<Request[]>(kSlabSize));
+      for (size_t i = 0; i < kSlabSize; ++i) {
+        slabs_.back()[i].next = free_;
+        free_ = &slabs_.back()[i];
+      }
+    }
+    auto& request = *free_;
+    free_ = request.next;
+    request.next = nullptr;
+    return request;
+  }
+
+  void Release(Request& _request) {
+    // Large destinations aren't kept.
+    _request.buffer.clear();
+    if (_request.buffer.capacity() > kMaxRetainedSize) {
+      _request.buffer.shrink_to_fit();
+    }
+    _request.completion = nullptr;
+    _request.transfer = nullptr;
+    _request.consumer = nullptr;
+    _request.notified = false;
+    if (_request.scratch.data) {
+      ReleaseScratch(std::move(_request.scratch));
+      _request.scratch = {};
+    }
+    _request.next = free_;
+    free_ = &_request;
+  }
+
+  // Returns a pooled scratch buffer of at least _size bytes, smallest first.
+  Scratch AcquireScratch(size_t _size) {
+    auto best = scratches_.end();
+    for (auto it = scratches_.begin(); it != scratches_.end(); ++it) {
+      if (it->size >= _size && (best == scratches_.end() ||
+                                it->size < best->size)) {
+        best = it;
+      }
+    }
+    if (best == scratches_.end()) {
+      return {std::make_unique<std::byte[]>(_size), _size};
+    }
+    auto scratch = std::move(*best);
+    scratches_.erase(best);
+    return scratch;
+  }
+
+ private:
+  // Keeps a scratch buffer per lane, as many as can stream concurrently.
+  void ReleaseScratch(Scratch&& _scratch) {
+    const auto desc = sfetch_desc();
+    const auto capacity = static_cast<size_t>(desc.num_channels) *
+                          static_cast<size_t>(desc.num_lanes);
+    if (scratches_.size() < capacity) {
+      scratches_.push_back(std::move(_scratch));
+    }
+  }
+
+  static constexpr size_t kSlabSize = 64;
+  static constexpr size_t kMaxRetainedSize = 64 << 10;
+
+  std::vector<std::unique_ptr<Request[]>> slabs_;
+  Request* free_ = nullptr;
+  std::vector<Scratch> scratches_;
+} requests;
+
+// sokol_fetch copies user data, so it only references the record.
 struct UserData {
-  std::vector<std::byte>* buffer = nullptr;
-  AsyncBuffer::Completion* completion = nullptr;
+  Request* request;
 };
 static_assert(std::is_trivially_copyable<UserData>{});
+
+// Requests are spread round-robin across channels, so they're processed
+// concurrently.
+uint32_t NextChannel() {
+  static uint32_t next = 0;
+  return next++ % sfetch_desc().num_channels;
+}
+
+sfetch_handle_t SendChunked(const char* _filename, Request& _request,
+                            size_t _chunk_size,
+                            void (*_callback)(const sfetch_response_t*)) {
+  _request.scratch = requests.AcquireScratch(_chunk_size);
+  const auto user_data = UserData{&_request};
+  auto handle = sfetch_send(
+      sfetch_request_t{.channel = NextChannel(),
+                       .path = _filename,
+                       .callback = _callback,
+                       .chunk_size = static_cast<uint32_t>(_chunk_size),
+                       .buffer = {_request.scratch.data.get(), _chunk_size},
+                       .user_data = SFETCH_RANGE(user_data)});
+  assert(sfetch_handle_valid(handle));
+  return handle;
+}
+
+// Loads the whole file to _request buffer.
+sfetch_handle_t SendWhole(const char* _filename, Request& _request,
+                          size_t _buffering_size,
+                          void (*_callback)(const sfetch_response_t*)) {
+#if !defined(__EMSCRIPTEN__)
+  // Fetches the whole file at once, directly to its destination.
+  std::error_code error;
+  const auto size = std::filesystem::file_size(_filename, error);
+  if (!error && size > 0) {
+    _request.buffer.resize(size);
+    const auto user_data = UserData{&_request};
+    auto handle = sfetch_send(
+        sfetch_request_t{.channel = NextChannel(),
+                         .path = _filename,
+                         .callback = _callback,
+                         .buffer = {_request.buffer.data(), size},
+                         .user_data = SFETCH_RANGE(user_data)});
+    assert(sfetch_handle_valid(handle));
+    return handle;
+  }
+#endif  // __EMSCRIPTEN__
+
+  // Streams by chunks, as size isn't known.
+  return SendChunked(_filename, _request, _buffering_size, _callback);
+}
 }  // namespace
 
 AsyncBuffer::AsyncBuffer(const char* _filename, const Completion& _completion,
                          size_t _buffering_size) {
-  auto user_data =
-      UserData{.buffer = new std::vector<std::byte>{},
-               .completion = new AsyncBuffer::Completion{_completion}};
-
-  auto scratch = malloc(_buffering_size);
-  handle_ = sfetch_send(
-      sfetch_request_t{.path = _filename,
-                       .callback = &FetchCallback,
-                       .chunk_size = static_cast<uint32_t>(_buffering_size),
-                       .buffer = {scratch, _buffering_size},
-                       .user_data = SFETCH_RANGE(user_data)});
-  assert(sfetch_handle_valid(handle_));
+  auto& request = requests.Acquire();
+  request.completion = _completion;
+  handle_ = SendWhole(_filename, request, _buffering_size, &FetchCallback);
+}
+
+AsyncBuffer AsyncBuffer::Take(const char* _filename,
+                              const Transfer& _completion,
+                              size_t _buffering_size) {
+  auto& request = requests.Acquire();
+  request.transfer = _completion;
+  AsyncBuffer buffer;
+  buffer.handle_ =
+      SendWhole(_filename, request, _buffering_size, &FetchCallback);
+  return buffer;
+}
+
+AsyncBuffer AsyncBuffer::Stream(const char* _filename,
+                                const Consumer& _consumer,
+                                const Completion& _completion,
+                                size_t _chunk_size) {
+  auto& request = requests.Acquire();
+  request.completion = _completion;
+  request.consumer = _consumer;
+
+  // A single scratch buffer is reused by all chunks.
+  AsyncBuffer buffer;
+  buffer.handle_ = SendChunked(_filename, request, _chunk_size, &FetchCallback);
+  return buffer;
 }
 
 AsyncBuffer::~AsyncBuffer() { sfetch_cancel(handle_); }
 
 void AsyncBuffer::FetchCallback(const sfetch_response_t* _reponse) {
-  auto& user_data = *reinterpret_cast<UserData*>(_reponse->user_data);
+  auto& request =
+      *reinterpret_cast<const UserData*>(_reponse->user_data)->request;
 
-  if (_reponse->fetched) {
-    auto& buffer = *user_data.buffer;
+  auto& buffer = request.buffer;
+  const bool direct = !request.scratch.data;
+  const std::byte* stream = static_cast<const std::byte*>(_reponse->data.ptr);
 
+  if (_reponse->fetched && request.consumer) {
+    // Passes chunk to the consumer, which can interrupt loading.
+    const auto chunk = std::span{stream, _reponse->data.size};
+    if (!request.notified && !request.consumer(chunk, _reponse->data_offset)) {
+      request.completion(false, {}, _reponse->path);
+      request.notified = true;
+      sfetch_cancel(_reponse->handle);
+    }
+  } else if (_reponse->fetched && direct) {
+    // Data was read in place, file might be smaller than expected though.
+    buffer.resize(_reponse->data.size);
+  } else if (_reponse->fetched) {
     // Append fetched data
     const auto min_size = _reponse->data_offset + _reponse->data.size;
     if (min_size > buffer.size()) {
       buffer.resize(min_size);
     }
-    const std::byte* stream = static_cast<const std::byte*>(_reponse->data.ptr);
     std::copy(stream, stream + _reponse->data.size,
               buffer.data() + _reponse->data_offset);
   }
 
   if (_reponse->finished) {
-    if (_reponse->cancelled) {
+    if (_reponse->cancelled || request.notified) {
       // Silence...
+    } else if (request.transfer) {
+      // Notifies completion, giving away the buffer.
+      request.transfer(!_reponse->failed, std::move(buffer), _reponse->path);
     } else {
       // Notifies completion
-      (*user_data.completion)(!_reponse->failed, *user_data.buffer,
-                              _reponse->path);
+      request.completion(!_reponse->failed, buffer, _reponse->path);
     }
 
-    // Free streaming buffer
-    auto* scratch = sfetch_unbind_buffer(_reponse->handle);
-    free(scratch);
-
-    // Free user data
-    delete user_data.buffer;
-    delete user_data.completion;
+    // Recycles request record and its scratch buffer.
+    sfetch_unbind_buffer(_reponse->handle);
+    requests.Release(request);
   }
 }
 
 namespace {
-void LoadImageImpl(std::span<const std::byte> _buffer, sg_image _image,
-                   const char* _name) {
-  int width, height, channels;
-  stbi_uc* pixels = stbi_load_from_memory(
-      reinterpret_cast<const stbi_uc*>(_buffer.data()),
-      static_cast<int>(_buffer.size_bytes()), &width, &height, &channels, 4);
-  if (!pixels) {
-    // Failed to load image from buffer
-    const char* error = stbi_failure_reason();
-    sg_fail_image(_image);
-  } else {
-    // Init image from pixels
-    sg_init_image(
-        _image,
-        sg_image_desc{.width = width,
-                      .height = height,
-                      .pixel_format = SG_PIXELFORMAT_RGBA8,
-                      .data = {.subimage = {{{.ptr = pixels,
-                                              .size = static_cast<size_t>(
-                                                  width * height * 4)}}}},
-                      .label = _name});
-    stbi_image_free(pixels);
+// Image decoded by a worker, waiting to be uploaded from the main thread.
+struct DecodedImage {
+  sg_image image;
+  std::string name;
+  bool success = false;
+  ImagePayload payload;
+
+  size_t size() const { return payload.data.size(); }
+};
+
+// Decoding and uploading state, shared by all SgAsyncImage.
+struct AsyncImages {
+  JobSystem* jobs = nullptr;
+  JobSystem::Counter decoding = 0;
+  size_t upload_budget = kDefaultUploadBudget;
+
+  // Decoded images cache directory, disabled if empty.
+  std::string cache_dir;
+
+  // Decoded images, in decoding completion order.
+  std::mutex mutex;
+  std::deque<DecodedImage> decoded;
+} async_images;
+
+void UploadImage(const DecodedImage& _decoded) {
+  // Image might have been destroyed while decoding.
+  if (sg_query_image_state(_decoded.image) != SG_RESOURCESTATE_ALLOC) {
+    return;
   }
+
+  // Failed to decode, or compressed format isn't supported by the backend.
+  const auto& payload = _decoded.payload;
+  if (!_decoded.success || !sg_query_pixelformat(payload.format).sample) {
+    sg_fail_image(_decoded.image);
+    return;
+  }
+
+  // Init image from all levels
+  auto desc = sg_image_desc{.width = payload.width,
+                            .height = payload.height,
+                            .num_mipmaps = payload.mips,
+                            .pixel_format = payload.format,
+                            .label = _decoded.name.c_str()};
+  for (int i = 0; i < payload.mips; ++i) {
+    const auto level = payload.level(i);
+    desc.data.subimage[0][i] = {.ptr = level.data(), .size = level.size()};
+  }
+  sg_init_image(_decoded.image, desc);
+}
+
+// Decodes _file, from the cache if it was already decoded by a previous
+// launch. Files that aren't decoded (KTX2, DDS) aren't cached.
+bool DecodeCachedImage(std::vector<std::byte>&& _file, bool _mips,
+                       ImagePayload& _payload) {
+  const auto& dir = async_images.cache_dir;
+  if (dir.empty() || IsImageContainer(_file)) {
+    return DecodeImage(std::move(_file), _mips, _payload);
+  }
+  const auto path = CachedImagePath(dir, HashContent(_file), _mips);
+  if (LoadCachedImage(path, _payload)) {
+    return true;
+  }
+  if (!DecodeImage(std::move(_file), _mips, _payload)) {
+    return false;
+  }
+  SaveCachedImage(path, _payload);  // Failing to cache isn't an error.
+  return true;
 }
 }  // namespace
 
-SgAsyncImage::SgAsyncImage(const char* _filename)
-    : image_{sg_alloc_image()},
-      buffer_{_filename,
-              std::bind(&SgAsyncImage::Completed, image_.id(), _1, _2, _3)} {}
+void SetupAsyncImages(JobSystem* _jobs, size_t _upload_budget,
+                      const char* _cache_dir) {
+  async_images.jobs = _jobs;
+  async_images.upload_budget = _upload_budget;
+  async_images.cache_dir = _cache_dir ? _cache_dir : "";
+  if (!async_images.cache_dir.empty()) {
+    std::error_code error;
+    std::filesystem::create_directories(async_images.cache_dir, error);
+  }
+}
+
+void ShutdownAsyncImages() {
+  if (async_images.jobs) {
+    async_images.jobs->Wait(async_images.decoding);
+  }
+  async_images.jobs = nullptr;
+  async_images.cache_dir.clear();
+
+  std::lock_guard lock(async_images.mutex);
+  async_images.decoded.clear();
+}
+
+void UploadAsyncImages() {
+  size_t uploaded = 0;
+  for (;;) {
+    DecodedImage decoded;
+    {
+      std::lock_guard lock(async_images.mutex);
+      auto& queue = async_images.decoded;
+      if (queue.empty() ||
+          (uploaded > 0 &&
+           uploaded + queue.front().size() > async_images.upload_budget)) {
+        break;
+      }
+      decoded = std::move(queue.front());
+      queue.pop_front();
+    }
+    UploadImage(decoded);
+    uploaded += decoded.size();
+  }
+}
+
+SgAsyncImage::SgAsyncImage(const char* _filename, bool _mips) {
+  // Shares the image if file is already loaded or loading.
+  auto& shared = shared_images(_mips)[_filename];
+  shared_ = shared.lock();
+  if (shared_) {
+    return;
+  }
+  shared_ = std::make_shared<Shared>();
+  shared_->path = _filename;
+  shared_->mips = _mips;
+  shared_->image = SgImage{sg_alloc_image()};
+  shared_->buffer = AsyncBuffer::Take(
+      _filename, std::bind(&SgAsyncImage::Completed, shared_->image.id(),
+                           _mips, _1, _2, _3));
+  shared = shared_;
+}
 
-void SgAsyncImage::Completed(sg_image _image, bool _successs,
-                             std::span<const std::byte> _buffer,
+SgAsyncImage::Shared::~Shared() {
+  // Another image might have been shared for this path meanwhile.
+  auto& images = shared_images(mips);
+  const auto it = images.find(path);
+  if (it != images.end() && it->second.expired()) {
+    images.erase(it);
+  }
+}
+
+SgAsyncImage::SharedImages& SgAsyncImage::shared_images(bool _mips) {
+  static SharedImages images[2];
+  return images[_mips];
+}
+
+void SgAsyncImage::Completed(sg_image _image, bool _mips, bool _successs,
+                             std::vector<std::byte>&& _buffer,
                              const char* _filename) {
   assert(sg_query_image_state(_image) == SG_RESOURCESTATE_ALLOC);
-  if (_successs) {
-    LoadImageImpl(_buffer, _image, _filename);
-  } else {
+  if (!_successs) {
     sg_fail_image(_image);
+    return;
+  }
+
+  // Fetched buffer is moved to the decoding job.
+  auto decode = [_image, _mips, name = std::string{_filename},
+                 buffer = std::move(_buffer)]() mutable {
+    auto decoded = DecodedImage{.image = _image, .name = std::move(name)};
+    decoded.success =
+        DecodeCachedImage(std::move(buffer), _mips, decoded.payload);
+    std::lock_guard lock(async_images.mutex);
+    async_images.decoded.push_back(std::move(decoded));
+  };
+  if (async_images.jobs) {
+    async_images.jobs->SubmitBackground(std::move(decode),
+                                        async_images.decoding);
+  } else {
+    decode();
   }
 }
 
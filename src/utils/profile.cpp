@@ -1,8 +1,16 @@
 #include "flip/utils/profile.h"
 
 #include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
 #include <numeric>
 
+#include "imgui/imgui.h"
 #include "sokol/sokol_time.h"
 
 namespace flip {
@@ -18,6 +26,123 @@ ProfileStats stats(std::span<const float> _data) {
           *std::max_element(_data.begin(), _data.end())};
 }
 
+void plot(const char* _label, const ProfileRecord& _record) {
+  auto [data, offset] = _record.view();
+  auto [min, mean, max] = stats(data);
+  char overlay[64];
+  std::snprintf(overlay, sizeof(overlay),
+                "Min %.2g ms\nMean %.2g ms\nMax %.2g ms", min, mean, max);
+  ImGui::PlotLines(_label, data.data(), data.size(), offset, overlay, min, max,
+                   ImVec2{0, 80});
+}
+
+ProfileHistogram::ProfileHistogram(int _window, float _budget)
+    : budget_{_budget} {
+  resize(_window);
+}
+
+int ProfileHistogram::Bin(float _value) {
+  return std::clamp(static_cast<int>(_value / kBinWidth), 0, kBinCount - 1);
+}
+
+void ProfileHistogram::push(float _value) {
+  const int size = window();
+  if (count_ == size) {
+    // Evicts the oldest value.
+    const int oldest = Bin(window_[offset_]);
+    --bins_[oldest];
+    hitches_ -= (oldest + 1) * kBinWidth > budget_;
+  } else {
+    ++count_;
+  }
+
+  const auto bin = Bin(_value);
+  window_[offset_] = _value;
+  offset_ = (offset_ + 1) % size;
+  ++bins_[bin];
+
+  // Hitches are counted with bins precision, so eviction stays consistent.
+  const bool hitch = (bin + 1) * kBinWidth > budget_;
+  hitches_ += hitch;
+  total_hitches_ += hitch;
+}
+
+void ProfileHistogram::resize(int _window) {
+  assert(_window > 0);
+  window_.assign(_window, 0.f);
+  bins_.fill(0);
+  offset_ = count_ = hitches_ = 0;
+}
+
+void ProfileHistogram::set_budget(float _budget) {
+  budget_ = _budget;
+
+  // Recounts window hitches with the new budget.
+  hitches_ = 0;
+  for (int bin = 0; bin < kBinCount; ++bin) {
+    hitches_ += (bin + 1) * kBinWidth > budget_ ? bins_[bin] : 0;
+  }
+}
+
+float ProfileHistogram::percentile(float _p) const {
+  const int rank = static_cast<int>(std::ceil(_p * count_));
+  int accumulated = 0;
+  for (int bin = 0; bin < kBinCount - 1; ++bin) {
+    accumulated += bins_[bin];
+    if (accumulated >= rank && accumulated > 0) {
+      return (bin + 1) * kBinWidth;
+    }
+  }
+  if (bins_[kBinCount - 1] == 0) {
+    return 0.f;
+  }
+
+  // Last bin counts overflows, which are selected from window values so long
+  // hitches aren't clamped to bins range.
+  std::vector<float> overflows;
+  overflows.reserve(bins_[kBinCount - 1]);
+  for (int i = 0; i < count_; ++i) {
+    if (Bin(window_[i]) == kBinCount - 1) {
+      overflows.push_back(window_[i]);
+    }
+  }
+  const auto nth = overflows.begin() +
+                   std::clamp<int>(rank - accumulated - 1, 0,
+                                   static_cast<int>(overflows.size()) - 1);
+  std::nth_element(overflows.begin(), nth, overflows.end());
+  return std::max(*nth, kBinCount * kBinWidth);
+}
+
+void ProfileHistogram::Gui(const char* _label) {
+  ImGui::PushID(_label);
+  ImGui::TextUnformatted(_label);
+  ImGui::Text("p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, p99.9 %.1f ms",
+              percentile(.5f), percentile(.9f), percentile(.99f),
+              percentile(.999f));
+  ImGui::Text("Hitches %d in window, %d total", hitches_, total_hitches_);
+
+  float budget = budget_;
+  if (ImGui::SliderFloat("Budget", &budget, 1.f, 100.f, "%.1f ms")) {
+    set_budget(budget);
+  }
+  int size = window();
+  if (ImGui::SliderInt("Window", &size, 64, 16384, "%d",
+                       ImGuiSliderFlags_Logarithmic)) {
+    resize(size);
+  }
+
+  // Coarser 1 ms bins histogram, up to p99.9.
+  constexpr int kCoarse = 10;
+  float coarse[kBinCount / kCoarse] = {};
+  const int last = Bin(percentile(.999f));
+  for (int bin = 0; bin <= last; ++bin) {
+    coarse[bin / kCoarse] += static_cast<float>(bins_[bin]);
+  }
+  ImGui::PlotHistogram("Distribution", coarse, last / kCoarse + 1, 0,
+                       "1 ms bins", 0.f, FLT_MAX, ImVec2{0, 80});
+  ImGui::PopID();
+}
+
 Profile::Profile(ProfileRecord& _record)
     : record_{_record}, start_{stm_now()} {}
 
@@ -26,4 +151,173 @@ Profile ::~Profile() {
   record_.push(static_cast<float>(stm_ms(elapsed)));
 }
 
-}  // namespace flip
\ No newline at end of file
+namespace {
+// Events of a thread, shared with the registry so they can be collected, even
+// after the thread exited. Capacity is kept from one frame to the next, so
+// recording doesn't allocate once warmed up.
+struct ThreadEvents {
+  std::mutex mutex;  // Only contended while collecting.
+  uint32_t id = 0;
+  const char* name = "Thread";
+  std::vector<ProfileEvent> events;
+};
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<ThreadEvents>> threads;
+  uint32_t next_id = 0;
+};
+Registry& registry() {
+  static Registry registry;
+  return registry;
+}
+
+ThreadEvents& thread_events() {
+  thread_local const auto events = []() {
+    auto events = std::make_shared<ThreadEvents>();
+    auto& registry = flip::registry();
+    std::lock_guard lock(registry.mutex);
+    events->id = registry.next_id++;
+    registry.threads.push_back(events);
+    return events;
+  }();
+  return *events;
+}
+
+void Record(const char* _name) {
+  auto& thread = thread_events();
+  std::lock_guard lock(thread.mutex);
+  thread.events.push_back({_name, stm_now()});
+}
+}  // namespace
+
+ProfileScope::ProfileScope(const char* _name) { Record(_name); }
+
+ProfileScope::~ProfileScope() { Record(nullptr); }
+
+void set_thread_profile_name(const char* _name) {
+  auto& thread = thread_events();
+  std::lock_guard lock(thread.mutex);
+  thread.name = _name;
+}
+
+void collect_profile_events(std::vector<ProfileThread>& _threads) {
+  auto& current = thread_events();
+  auto& registry = flip::registry();
+  std::lock_guard lock(registry.mutex);
+
+  size_t count = 0;
+  auto collect = [&_threads, &count](ThreadEvents& _thread) {
+    std::lock_guard lock(_thread.mutex);
+
+    // Only complete top level scopes are collected.
+    auto& events = _thread.events;
+    size_t end = 0;
+    for (size_t i = 0, depth = 0; i < events.size(); ++i) {
+      depth = events[i].name ? depth + 1 : depth - 1;
+      end = depth == 0 ? i + 1 : end;
+    }
+
+    if (count == _threads.size()) {
+      _threads.emplace_back();
+    }
+    auto& thread = _threads[count++];
+    thread.id = _thread.id;
+    thread.name = _thread.name;
+    thread.events.assign(events.begin(), events.begin() + end);
+    events.erase(events.begin(), events.begin() + end);
+  };
+  collect(current);
+  for (const auto& thread : registry.threads) {
+    if (thread.get() != &current) {
+      collect(*thread);
+    }
+  }
+  _threads.resize(count);
+
+  // Forgets threads that exited, once all their events were collected.
+  std::erase_if(registry.threads, [](const auto& _thread) {
+    return _thread.use_count() == 1 && _thread->events.empty();
+  });
+}
+
+int ProfileTree::Find(int _parent, const char* _name) {
+  auto it = std::find_if(
+      nodes_.begin() + (_parent + 1), nodes_.end(), [&](const Node& _node) {
+        return _node.parent == _parent && std::strcmp(_node.name, _name) == 0;
+      });
+  if (it == nodes_.end()) {
+    it = nodes_.insert(nodes_.end(), Node{.name = _name,
+                                          .parent = _parent,
+                                          .calls = 0,
+                                          .inclusive = 0,
+                                          .exclusive = 0});
+  }
+  return static_cast<int>(it - nodes_.begin());
+}
+
+void ProfileTree::Aggregate(std::span<const ProfileThread> _threads) {
+  nodes_.clear();
+  for (size_t i = 0; i < _threads.size(); ++i) {
+    if (!_threads[i].events.empty()) {
+      Aggregate(i == 0 ? -1 : Find(-1, "Other threads"), _threads[i].events);
+    }
+  }
+}
+
+void ProfileTree::Aggregate(int _root, std::span<const ProfileEvent> _events) {
+  stack_.clear();
+  for (const auto& event : _events) {
+    if (event.name) {
+      const int parent = stack_.empty() ? _root : stack_.back().first;
+      const int index = Find(parent, event.name);
+      ++nodes_[index].calls;
+      stack_.emplace_back(index, event.time);
+    } else if (!stack_.empty()) {
+      // Time spent in a child is excluded from its parent. Root only sums
+      // its children, as they ran on different threads.
+      const auto [index, begin] = stack_.back();
+      stack_.pop_back();
+      const auto elapsed = static_cast<float>(stm_ms(event.time - begin));
+      auto& node = nodes_[index];
+      node.inclusive += elapsed;
+      node.exclusive += elapsed;
+      if (node.parent == _root && _root >= 0) {
+        nodes_[_root].inclusive += elapsed;
+        ++nodes_[_root].calls;
+      } else if (node.parent >= 0) {
+        nodes_[node.parent].exclusive -= elapsed;
+      }
+    }
+  }
+}
+
+void ProfileTree::Gui(float _frame) const { Gui(-1, _frame); }
+
+void ProfileTree::Gui(int _parent, float _frame) const {
+  for (int i = _parent + 1; i < static_cast<int>(nodes_.size()); ++i) {
+    const auto& node = nodes_[i];
+    if (node.parent != _parent) {
+      continue;
+    }
+    const bool leaf = std::none_of(
+        nodes_.begin() + i + 1, nodes_.end(),
+        [i](const Node& _node) { return _node.parent == i; });
+    const auto flags = ImGuiTreeNodeFlags_DefaultOpen |
+                       ImGuiTreeNodeFlags_SpanAvailWidth |
+                       (leaf ? ImGuiTreeNodeFlags_Leaf : 0);
+    const bool open =
+        ImGui::TreeNodeEx(&node, flags, "%s: %.2f ms, self %.2f ms, %d calls",
+                        node.name, node.inclusive, node.exclusive, node.calls);
+
+    // Flame like bar, proportional to the frame time.
+    ImGui::ProgressBar(_frame > 0.f ? node.inclusive / _frame : 0.f,
+                       ImVec2{-1.f, 2.f}, "");
+    if (open) {
+      Gui(i, _frame);
+      ImGui::TreePop();
+    }
+  }
+}
+
+}  // namespace flip
@@ -2,20 +2,44 @@
 
 namespace flip {
 BufferBinding SgDynamicBuffer::Append(std::span<const std::byte> _data) {
-  if (!buffer_.is_valid() ||
-      sg_query_buffer_will_overflow(buffer_.id(), _data.size_bytes())) {
+  const auto size = _data.size_bytes();
+  if (!buffer_.is_valid() || stats_.size < reserve_ ||
+      sg_query_buffer_will_overflow(buffer_.id(), size)) {
     // Reallocates the buffer to be able to store enough data for the frame.
-    // This shall happens until a stable maximum size (per frame) is reached.
-    // sokol manages frame counter internally.
-    const auto& info = sg_query_buffer_info(buffer_.id());
-    buffer_ = MakeSgBuffer(
-        sg_buffer_desc{.size = info.append_pos + _data.size_bytes(),
-                       .usage = SG_USAGE_STREAM,
-                       .label = "flip:: dynamic buffer"});
+    // Growth is geometric so this shall quickly stop happening once a stable
+    // maximum size (per frame) is reached. sokol manages frame counter
+    // internally.
+    size_t used = 0;
+    if (buffer_.is_valid()) {
+      used = sg_query_buffer_info(buffer_.id()).append_pos;
+      retired_.push_back({std::move(buffer_), frame_});
+    }
+    auto new_size = std::max({stats_.size * 2, used + size, reserve_});
+    new_size = (new_size + 3) & ~size_t{3};  // Appends are 4 bytes aligned.
+    buffer_ = MakeSgBuffer(sg_buffer_desc{.size = new_size,
+                                          .usage = SG_USAGE_STREAM,
+                                          .label = "flip:: dynamic buffer"});
+    stats_.size = new_size;
+    ++stats_.reallocations;
   }
-  return {.id = buffer_.id(),
-          .offset = sg_append_buffer(
-              buffer_.id(),
-              sg_range{.ptr = _data.data(), .size = _data.size_bytes()})};
+
+  const auto offset = sg_append_buffer(
+      buffer_.id(), sg_range{.ptr = _data.data(), .size = size});
+
+  // Tracks frames, to update stats and release retired buffers.
+  const auto frame = sg_query_buffer_info(buffer_.id()).append_frame_index;
+  if (frame != frame_) {
+    stats_.frame_bytes = frame_bytes_;
+    frame_bytes_ = 0;
+    frame_ = frame;
+
+    std::erase_if(retired_, [frame](const Retired& _retired) {
+      return frame - _retired.frame > SG_NUM_INFLIGHT_FRAMES;
+    });
+  }
+  frame_bytes_ += size;
+  stats_.total_bytes += size;
+
+  return {.id = buffer_.id(), .offset = offset};
 }
-}  // namespace flip
\ No newline at end of file
+}  // namespace flip
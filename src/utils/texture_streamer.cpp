@@ -0,0 +1,323 @@
+#include "flip/utils/texture_streamer.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "flip/utils/jobs.h"
+#include "image_decoder.h"
+
+namespace flip {
+
+namespace {
+// Largest size of the levels uploaded first.
+constexpr int kBaseSize = 64;
+
+// Maximum number of textures being fetched, decoded or holding decoded
+// levels.
+constexpr int kMaxInFlight = 4;
+
+// Handle id is made of slot + 1 in the low bits, and slot version in the
+// high bits.
+constexpr int kSlotBits = 16;
+constexpr uint32_t kSlotMask = (1u << kSlotBits) - 1;
+}  // namespace
+
+struct TextureStreamer::Entry {
+  uint32_t slot = 0;
+  bool alive = false;
+  std::string path;
+
+  // Incremented when entry is released, so its handles aren't valid anymore.
+  uint32_t version = 0;
+
+  // Incremented when entry is evicted or released, so decodings started
+  // before are discarded.
+  uint32_t generation = 0;
+
+  enum State { kUnloaded, kQueued, kLoading, kStreaming, kComplete, kFailed };
+  State state = kUnloaded;
+
+  AsyncBuffer buffer;
+
+  // Decoded levels, kept until they are all resident.
+  std::unique_ptr<ImagePayload> payload;
+
+  // First resident level, payload->mips if none, and their size.
+  SgImage image;
+  int first = 0;
+  size_t bytes = 0;
+
+  uint64_t last_used = 0;
+};
+
+TextureStreamer::TextureStreamer(JobSystem* _jobs, size_t _budget,
+                                 size_t _upload_budget)
+    : jobs_{_jobs},
+      budget_{_budget},
+      upload_budget_{_upload_budget},
+      pending_{sg_alloc_image()} {}
+
+TextureStreamer::~TextureStreamer() {
+  // Decoding jobs reference this streamer.
+  if (jobs_) {
+    jobs_->Wait(decoding_);
+  }
+}
+
+TextureStreamer::Texture TextureStreamer::Load(const char* _filename) {
+  // Finds a free slot or allocates a new one.
+  auto it = std::find_if(entries_.begin(), entries_.end(),
+                         [](auto& _e) { return !_e->alive; });
+  if (it == entries_.end()) {
+    assert(entries_.size() < kSlotMask && "Too many textures.");
+    it = entries_.insert(entries_.end(), std::make_unique<Entry>());
+    (*it)->slot = static_cast<uint32_t>(entries_.size() - 1);
+  }
+
+  auto& entry = **it;
+  entry.alive = true;
+  entry.path = _filename;
+  entry.last_used = frame_;
+  Stream(entry);
+
+  return {(entry.version << kSlotBits) | (entry.slot + 1)};
+}
+
+void TextureStreamer::Release(Texture _texture) {
+  auto* entry = Find(_texture);
+  if (entry) {
+    Evict(*entry);
+    entry->alive = false;
+    entry->version = (entry->version + 1) & (~0u >> kSlotBits);
+  }
+}
+
+TextureStreamer::Entry* TextureStreamer::Find(Texture _texture) {
+  const auto slot = _texture.id & kSlotMask;
+  if (slot == 0 || slot > entries_.size()) {
+    return nullptr;
+  }
+  auto& entry = *entries_[slot - 1];
+  return entry.alive && entry.version == _texture.id >> kSlotBits ? &entry
+                                                                 : nullptr;
+}
+
+sg_image TextureStreamer::Use(Texture _texture) {
+  auto* entry = Find(_texture);
+  if (!entry) {
+    return pending_.id();
+  }
+  entry->last_used = frame_;
+
+  // Evicted textures are loaded again.
+  if (entry->state == Entry::kUnloaded) {
+    Stream(*entry);
+  }
+  return entry->image.is_valid() ? entry->image.id() : pending_.id();
+}
+
+void TextureStreamer::Stream(Entry& _entry) {
+  _entry.state = Entry::kQueued;
+}
+
+void TextureStreamer::Fetch(Entry& _entry) {
+  _entry.state = Entry::kLoading;
+  const auto slot = _entry.slot, generation = _entry.generation;
+  _entry.buffer = AsyncBuffer::Take(
+      _entry.path.c_str(),
+      [this, slot, generation](bool _success, std::vector<std::byte>&& _buffer,
+                               const char* _filename) {
+        // Fetched buffer is moved to the decoding job.
+        auto decode = [this, slot, generation, _success,
+                       buffer = std::move(_buffer)]() mutable {
+          auto payload = std::make_unique<ImagePayload>();
+          if (!_success || !DecodeImage(std::move(buffer), true, *payload)) {
+            payload = nullptr;
+          }
+          std::lock_guard lock(mutex_);
+          decoded_.push_back({slot, generation, std::move(payload)});
+        };
+        if (jobs_) {
+          jobs_->SubmitBackground(std::move(decode), decoding_);
+        } else {
+          decode();
+        }
+      });
+}
+
+void TextureStreamer::Evict(Entry& _entry) {
+  retired_.push_back(std::move(_entry.image));
+  retired_bytes_ += _entry.bytes;
+  bytes_ -= _entry.bytes;
+  _entry.bytes = 0;
+  _entry.payload = nullptr;
+  _entry.buffer = {};
+  _entry.state = Entry::kUnloaded;
+  ++_entry.generation;
+}
+
+size_t TextureStreamer::Refine(Entry& _entry, size_t _upload) {
+  const auto& payload = *_entry.payload;
+  if (!sg_query_pixelformat(payload.format).sample) {
+    _entry.payload = nullptr;
+    _entry.state = Entry::kFailed;
+    return 0;
+  }
+
+  // Smallest levels are uploaded first, up to kBaseSize, then as many levels
+  // as _upload allows, at least one. As images are immutable, all resident
+  // levels are uploaded again, so refining by bigger steps reduces uploads.
+  int first = _entry.first - 1;
+  size_t bytes = 0;
+  for (int i = first; i < payload.mips; ++i) {
+    bytes += payload.levels[i].size;
+  }
+  while (first > 0) {
+    const bool base = std::max(payload.width >> (first - 1),
+                               payload.height >> (first - 1)) <= kBaseSize;
+    const auto next = bytes + payload.levels[first - 1].size;
+    if (_entry.first == payload.mips ? !base : next > _upload) {
+      break;
+    }
+    --first;
+    bytes = next;
+  }
+
+  // Makes room by evicting least recently used textures, among those that
+  // weren't used this frame or the previous one.
+  while (bytes_ - _entry.bytes + bytes > budget_) {
+    Entry* lru = nullptr;
+    for (auto& entry : entries_) {
+      if (entry->bytes > 0 && entry.get() != &_entry &&
+          entry->last_used + 1 < frame_ &&
+          (!lru || entry->last_used < lru->last_used)) {
+        lru = entry.get();
+      }
+    }
+    if (!lru) {
+      return 0;
+    }
+    Evict(*lru);
+    ++evictions_;
+  }
+
+  // Replaced and evicted images are only destroyed next update, upload is
+  // postponed until they fit in the budget too.
+  if (bytes_ + retired_bytes_ + bytes > budget_) {
+    return 0;
+  }
+
+  auto desc = sg_image_desc{.width = std::max(payload.width >> first, 1),
+                            .height = std::max(payload.height >> first, 1),
+                            .num_mipmaps = payload.mips - first,
+                            .pixel_format = payload.format,
+                            .label = _entry.path.c_str()};
+  for (int i = first; i < payload.mips; ++i) {
+    const auto level = payload.level(i);
+    desc.data.subimage[0][i - first] = {.ptr = level.data(),
+                                        .size = level.size()};
+  }
+  retired_.push_back(std::move(_entry.image));
+  retired_bytes_ += _entry.bytes;
+  _entry.image = MakeSgImage(desc);
+  bytes_ += bytes - _entry.bytes;
+  _entry.bytes = bytes;
+  _entry.first = first;
+
+  // Decoded levels aren't needed anymore once they're all resident.
+  if (first == 0) {
+    _entry.payload = nullptr;
+    _entry.state = Entry::kComplete;
+  }
+  return bytes;
+}
+
+void TextureStreamer::Update() {
+  ++frame_;
+
+  // Images retired by the previous update aren't referenced anymore.
+  retired_.clear();
+  retired_bytes_ = 0;
+
+  // Collects decoded textures.
+  std::vector<Decoded> decoded;
+  {
+    std::lock_guard lock(mutex_);
+    std::swap(decoded, decoded_);
+  }
+  for (auto& texture : decoded) {
+    auto& entry = *entries_[texture.slot];
+    if (entry.generation != texture.generation) {
+      continue;  // Evicted or released meanwhile.
+    }
+    entry.buffer = {};
+    if (!texture.payload) {
+      entry.state = Entry::kFailed;
+      continue;
+    }
+    entry.payload = std::move(texture.payload);
+    entry.first = entry.payload->mips;
+    entry.state = Entry::kStreaming;
+  }
+
+  // Starts fetching most recently used queued textures, as long as in
+  // flight ones allow it.
+  std::vector<Entry*> queued;
+  int in_flight = 0;
+  for (auto& entry : entries_) {
+    in_flight += entry->state == Entry::kLoading ||
+                 entry->state == Entry::kStreaming;
+    if (entry->state == Entry::kQueued) {
+      queued.push_back(entry.get());
+    }
+  }
+  std::sort(queued.begin(), queued.end(), [](auto* _a, auto* _b) {
+    return _a->last_used > _b->last_used;
+  });
+  for (size_t i = 0; i < queued.size() && in_flight < kMaxInFlight;
+       ++i, ++in_flight) {
+    Fetch(*queued[i]);
+  }
+
+  // Refines textures without any level first, then most recently used ones.
+  std::vector<Entry*> streaming;
+  for (auto& entry : entries_) {
+    if (entry->state == Entry::kStreaming) {
+      streaming.push_back(entry.get());
+    }
+  }
+  std::sort(streaming.begin(), streaming.end(), [](auto* _a, auto* _b) {
+    const bool a_empty = _a->bytes == 0, b_empty = _b->bytes == 0;
+    if (a_empty != b_empty) {
+      return a_empty;
+    }
+    if (_a->last_used != _b->last_used) {
+      return _a->last_used > _b->last_used;
+    }
+    return _a->first > _b->first;
+  });
+
+  // At least one level is uploaded per frame, whatever its size.
+  size_t uploaded = 0;
+  for (auto* entry : streaming) {
+    if (uploaded > 0 && uploaded >= upload_budget_) {
+      break;
+    }
+    if (entry->state == Entry::kStreaming) {  // Might have been evicted.
+      uploaded += Refine(*entry, upload_budget_ - uploaded);
+    }
+  }
+}
+
+TextureStreamer::Stats TextureStreamer::stats() const {
+  auto stats = Stats{.bytes = bytes_, .budget = budget_,
+                     .evictions = evictions_};
+  for (const auto& entry : entries_) {
+    stats.textures += entry->alive;
+    stats.resident += entry->bytes > 0;
+    stats.complete += entry->state == Entry::kComplete;
+  }
+  return stats;
+}
+
+}  // namespace flip
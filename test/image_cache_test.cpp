@@ -0,0 +1,101 @@
+#include "image_cache.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "image_decoder.h"
+#include "test.h"
+
+using namespace flip;
+
+namespace {
+// Cache file header offsets.
+constexpr size_t kMipsOffset = 20;
+constexpr size_t kLevelsOffset = 24;
+constexpr size_t kSizeOffset = kLevelsOffset + SG_MAX_MIPMAPS * 16;
+
+// RGBA8 2x2 payload with 2 levels.
+ImagePayload PayloadFixture() {
+  ImagePayload payload;
+  payload.format = SG_PIXELFORMAT_RGBA8;
+  payload.width = 2;
+  payload.height = 2;
+  payload.mips = 2;
+  payload.levels[0] = {.offset = 0, .size = 16};
+  payload.levels[1] = {.offset = 16, .size = 4};
+  for (int i = 0; i < 20; ++i) {
+    payload.data.push_back(static_cast<std::byte>(i));
+  }
+  return payload;
+}
+
+std::vector<std::byte> ReadFile(const std::string& _path) {
+  std::ifstream file(_path, std::ios::binary);
+  std::vector<char> data{std::istreambuf_iterator<char>(file), {}};
+  const auto* bytes = reinterpret_cast<const std::byte*>(data.data());
+  return {bytes, bytes + data.size()};
+}
+
+void WriteFile(const std::string& _path, const std::vector<std::byte>& _data) {
+  std::ofstream file(_path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(_data.data()), _data.size());
+}
+
+template <typename _Ty>
+void Patch(std::vector<std::byte>& _file, size_t _offset, _Ty _value) {
+  std::memcpy(_file.data() + _offset, &_value, sizeof(_Ty));
+}
+}  // namespace
+
+int main() {
+  const auto dir = std::filesystem::temp_directory_path() / "flip_cache_test";
+  std::filesystem::create_directories(dir);
+  const auto data = PayloadFixture().data;
+  const auto path = CachedImagePath(dir.string(), HashContent(data), true);
+
+  // Valid file round trip.
+  ImagePayload payload;
+  FLIP_EXPECT(!LoadCachedImage(path + ".missing", payload));
+  FLIP_EXPECT(SaveCachedImage(path, PayloadFixture()));
+  FLIP_EXPECT(LoadCachedImage(path, payload));
+  FLIP_EXPECT(payload.format == SG_PIXELFORMAT_RGBA8);
+  FLIP_EXPECT(payload.width == 2 && payload.height == 2 && payload.mips == 2);
+  FLIP_EXPECT(payload.levels[1].offset == 16 && payload.levels[1].size == 4);
+  FLIP_EXPECT(payload.data == data);
+  const auto valid = ReadFile(path);
+
+  // Truncated file, in the header or the data.
+  auto header = valid;
+  header.resize(kSizeOffset);
+  WriteFile(path, header);
+  FLIP_EXPECT(!LoadCachedImage(path, payload));
+  auto truncated = valid;
+  truncated.pop_back();
+  WriteFile(path, truncated);
+  FLIP_EXPECT(!LoadCachedImage(path, payload));
+
+  // Data size that doesn't match the file, which would otherwise be
+  // allocated.
+  auto size = valid;
+  Patch<uint64_t>(size, kSizeOffset, uint64_t{1} << 60);
+  WriteFile(path, size);
+  FLIP_EXPECT(!LoadCachedImage(path, payload));
+
+  // Oversized level table, levels not matching image size.
+  auto mips = valid;
+  Patch<int32_t>(mips, kMipsOffset, SG_MAX_MIPMAPS + 1);
+  WriteFile(path, mips);
+  FLIP_EXPECT(!LoadCachedImage(path, payload));
+  auto level = valid;
+  Patch<uint64_t>(level, kLevelsOffset + 8, 20);
+  WriteFile(path, level);
+  FLIP_EXPECT(!LoadCachedImage(path, payload));
+
+  std::error_code error;
+  std::filesystem::remove_all(dir, error);
+  return FLIP_TEST_RESULT();
+}
@@ -0,0 +1,133 @@
+#include "image_decoder.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "test.h"
+
+using namespace flip;
+
+namespace {
+// Little endian writes, growing _file as needed.
+template <typename _Ty>
+void Write(std::vector<std::byte>& _file, size_t _offset, _Ty _value) {
+  if (_file.size() < _offset + sizeof(_Ty)) {
+    _file.resize(_offset + sizeof(_Ty));
+  }
+  std::memcpy(_file.data() + _offset, &_value, sizeof(_Ty));
+}
+
+// KTX2 BC7 (VK_FORMAT_BC7_UNORM_BLOCK) 8x8 texture with 2 levels, stored
+// smallest first as KTX2 does.
+std::vector<std::byte> Ktx2Fixture() {
+  const uint8_t kIdentifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32,
+                                   0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+  std::vector<std::byte> file(80 + 2 * 24);
+  std::memcpy(file.data(), kIdentifier, sizeof(kIdentifier));
+  Write<uint32_t>(file, 12, 145);  // Format
+  Write<uint32_t>(file, 20, 8);    // Width
+  Write<uint32_t>(file, 24, 8);    // Height
+  Write<uint32_t>(file, 36, 1);    // Faces
+  Write<uint32_t>(file, 40, 2);    // Levels
+  Write<uint64_t>(file, 80, 144);  // Level 0 offset
+  Write<uint64_t>(file, 88, 64);   // Level 0 size
+  Write<uint64_t>(file, 104, 128);
+  Write<uint64_t>(file, 112, 16);
+  file.resize(208);
+  return file;
+}
+
+// DDS 32 bits 4x2 texture with 2 levels, with _r_mask red channel mask
+// and alpha pixels if _alpha.
+std::vector<std::byte> DdsFixture(uint32_t _r_mask, bool _alpha) {
+  std::vector<std::byte> file(128);
+  Write<uint32_t>(file, 0, 0x20534444);  // "DDS "
+  Write<uint32_t>(file, 12, 2);          // Height
+  Write<uint32_t>(file, 16, 4);          // Width
+  Write<uint32_t>(file, 28, 2);          // Mips
+  Write<uint32_t>(file, 80, 0x40 | (_alpha ? 0x1 : 0));
+  Write<uint32_t>(file, 88, 32);
+  Write<uint32_t>(file, 92, _r_mask);
+  Write<uint32_t>(file, 96, 0x0000ff00);
+  Write<uint32_t>(file, 100, _r_mask == 0x000000ff ? 0x00ff0000 : 0x000000ff);
+  for (int i = 0; i < (4 * 2 + 2 * 1) * 4; ++i) {
+    file.push_back(static_cast<std::byte>(i));
+  }
+  return file;
+}
+
+void TestKtx2() {
+  ImagePayload payload;
+  FLIP_EXPECT(DecodeImage(Ktx2Fixture(), true, payload));
+  FLIP_EXPECT(payload.format == SG_PIXELFORMAT_BC7_RGBA);
+  FLIP_EXPECT(payload.width == 8 && payload.height == 8);
+  FLIP_EXPECT(payload.mips == 2);
+  FLIP_EXPECT(payload.levels[0].offset == 144 && payload.levels[0].size == 64);
+  FLIP_EXPECT(payload.levels[1].offset == 128 && payload.levels[1].size == 16);
+
+  // Truncated level data.
+  auto truncated = Ktx2Fixture();
+  truncated.resize(truncated.size() - 1);
+  FLIP_EXPECT(!DecodeImage(std::move(truncated), true, payload));
+
+  // Truncated header.
+  auto header = Ktx2Fixture();
+  header.resize(60);
+  FLIP_EXPECT(!DecodeImage(std::move(header), true, payload));
+
+  // Level table exceeding the file, or sokol's maximum number of mips.
+  auto levels = Ktx2Fixture();
+  Write<uint32_t>(levels, 40, 3);
+  FLIP_EXPECT(!DecodeImage(std::move(levels), true, payload));
+  auto mips = Ktx2Fixture();
+  Write<uint32_t>(mips, 40, SG_MAX_MIPMAPS + 1);
+  FLIP_EXPECT(!DecodeImage(std::move(mips), true, payload));
+
+  // Level whose size doesn't match the format.
+  auto size = Ktx2Fixture();
+  Write<uint64_t>(size, 88, 65);
+  FLIP_EXPECT(!DecodeImage(std::move(size), true, payload));
+}
+
+void TestDds() {
+  ImagePayload payload;
+  FLIP_EXPECT(DecodeImage(DdsFixture(0x000000ff, true), true, payload));
+  FLIP_EXPECT(payload.format == SG_PIXELFORMAT_RGBA8);
+  FLIP_EXPECT(payload.width == 4 && payload.height == 2);
+  FLIP_EXPECT(payload.mips == 2);
+  FLIP_EXPECT(payload.levels[0].offset == 128 && payload.levels[0].size == 32);
+  FLIP_EXPECT(payload.levels[1].offset == 160 && payload.levels[1].size == 8);
+  FLIP_EXPECT(payload.level(1)[3] == std::byte{35});
+
+  // BGRA is swizzled, and alpha is opaque without alpha pixels.
+  FLIP_EXPECT(DecodeImage(DdsFixture(0x00ff0000, false), true, payload));
+  const auto texel = payload.level(0);
+  FLIP_EXPECT(texel[0] == std::byte{2} && texel[1] == std::byte{1} &&
+              texel[2] == std::byte{0} && texel[3] == std::byte{255});
+
+  // Truncated level data.
+  auto truncated = DdsFixture(0x000000ff, true);
+  truncated.resize(truncated.size() - 1);
+  FLIP_EXPECT(!DecodeImage(std::move(truncated), true, payload));
+
+  // Truncated header.
+  auto header = DdsFixture(0x000000ff, true);
+  header.resize(100);
+  FLIP_EXPECT(!DecodeImage(std::move(header), true, payload));
+
+  // Mips exceeding the file, or sokol's maximum number of mips.
+  auto levels = DdsFixture(0x000000ff, true);
+  Write<uint32_t>(levels, 28, 3);
+  FLIP_EXPECT(!DecodeImage(std::move(levels), true, payload));
+  auto mips = DdsFixture(0x000000ff, true);
+  Write<uint32_t>(mips, 28, SG_MAX_MIPMAPS + 1);
+  FLIP_EXPECT(!DecodeImage(std::move(mips), true, payload));
+}
+}  // namespace
+
+int main() {
+  TestKtx2();
+  TestDds();
+  return FLIP_TEST_RESULT();
+}
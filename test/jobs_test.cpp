@@ -0,0 +1,130 @@
+#include "flip/utils/jobs.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+
+using namespace flip;
+
+namespace {
+// Every index is visited exactly once, whatever the grain.
+void TestParallelFor(JobSystem& _jobs) {
+  for (const size_t grain : {size_t{0}, size_t{1}, size_t{7}, size_t{2000}}) {
+    std::vector<std::atomic<int>> visits(1000);
+    _jobs.ParallelFor(visits.size(), grain, [&](size_t _begin, size_t _end) {
+      for (size_t i = _begin; i < _end; ++i) {
+        ++visits[i];
+      }
+    });
+    bool once = true;
+    for (const auto& visit : visits) {
+      once &= visit == 1;
+    }
+    FLIP_EXPECT(once);
+  }
+
+  // Empty range doesn't call anything.
+  bool called = false;
+  _jobs.ParallelFor(0, 0, [&](size_t, size_t) { called = true; });
+  FLIP_EXPECT(!called);
+}
+
+// Jobs submitting and waiting for nested jobs.
+void TestNested(JobSystem& _jobs) {
+  std::atomic<int> leaves = 0;
+  JobSystem::Counter pending = 0;
+  for (int i = 0; i < 16; ++i) {
+    _jobs.Submit(
+        [&]() {
+          JobSystem::Counter nested = 0;
+          for (int j = 0; j < 16; ++j) {
+            _jobs.Submit([&]() { ++leaves; }, nested);
+          }
+          _jobs.Wait(nested);
+          FLIP_EXPECT(nested == 0);
+        },
+        pending);
+  }
+  _jobs.Wait(pending);
+  FLIP_EXPECT(pending == 0);
+  FLIP_EXPECT(leaves == 16 * 16);
+}
+
+// Graph dependencies are respected.
+void TestGraph(JobSystem& _jobs) {
+  std::atomic<int> step = 0;
+  int first = -1, second = -1;
+  JobGraph graph;
+  const auto b = graph.Add([&]() { second = step++; });
+  const auto a = graph.Add([&]() { first = step++; });
+  graph.Depend(b, a);
+  _jobs.Run(graph);
+  FLIP_EXPECT(first == 0 && second == 1);
+}
+
+// Background jobs are run by workers, not by waiting threads.
+void TestBackground(JobSystem& _jobs) {
+  const auto main = std::this_thread::get_id();
+  std::atomic<bool> on_main = false;
+  JobSystem::Counter background = 0;
+  for (int i = 0; i < 8; ++i) {
+    _jobs.SubmitBackground(
+        [&]() {
+          on_main = on_main || std::this_thread::get_id() == main;
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        },
+        background);
+  }
+  JobSystem::Counter pending = 0;
+  _jobs.Submit([]() {}, pending);
+  _jobs.Wait(pending);
+  _jobs.Wait(background);
+  FLIP_EXPECT(!on_main);
+}
+
+// Without workers, background jobs are run immediately.
+void TestBackgroundInline() {
+  JobSystem jobs(0);
+  JobSystem::Counter counter = 0;
+  bool run = false;
+  jobs.SubmitBackground([&]() { run = true; }, counter);
+  FLIP_EXPECT(run);
+  FLIP_EXPECT(counter == 0);
+}
+
+// Pending jobs are completed on destruction, with or without workers.
+void TestShutdown(int _workers) {
+  std::atomic<int> run = 0;
+  JobSystem::Counter pending = 0, background = 0;
+  {
+    JobSystem jobs(_workers);
+    for (int i = 0; i < 64; ++i) {
+      jobs.Submit([&]() { ++run; }, pending);
+      jobs.SubmitBackground([&]() { ++run; }, background);
+    }
+  }
+  FLIP_EXPECT(run == 128);
+  FLIP_EXPECT(pending == 0 && background == 0);
+}
+}  // namespace
+
+int main() {
+  JobSystem jobs(3);
+  TestParallelFor(jobs);
+  TestNested(jobs);
+  TestGraph(jobs);
+  TestBackground(jobs);
+
+  JobSystem single(0);
+  TestParallelFor(single);
+  TestNested(single);
+  TestGraph(single);
+
+  TestBackgroundInline();
+  TestShutdown(0);
+  TestShutdown(3);
+  return FLIP_TEST_RESULT();
+}
@@ -0,0 +1,113 @@
+#include "flip/utils/loader.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+
+using namespace flip;
+
+namespace {
+// Ticks sokol_fetch until *_done is set, or a timeout expires.
+bool Pump(const bool* _done) {
+  const auto timeout =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!*_done && std::chrono::steady_clock::now() < timeout) {
+    sfetch_dowork();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return *_done;
+}
+
+// Consumer reassembling streamed chunks, to compare them with the file.
+void TestStream(const std::string& _path,
+                const std::vector<std::byte>& _content) {
+  std::vector<std::byte> streamed(_content.size());
+  int chunks = 0;
+  bool done = false, success = false, empty = false;
+  auto buffer = AsyncBuffer::Stream(
+      _path.c_str(),
+      [&](std::span<const std::byte> _chunk, size_t _offset) {
+        FLIP_EXPECT(_offset + _chunk.size() <= streamed.size());
+        if (_offset + _chunk.size() <= streamed.size()) {
+          std::memcpy(streamed.data() + _offset, _chunk.data(), _chunk.size());
+        }
+        ++chunks;
+        return true;
+      },
+      [&](bool _success, std::span<const std::byte> _buffer, const char*) {
+        done = true;
+        success = _success;
+        empty = _buffer.empty();
+      },
+      1 << 10);
+  FLIP_EXPECT(Pump(&done));
+  FLIP_EXPECT(success && empty);
+  FLIP_EXPECT(chunks == 5);
+  FLIP_EXPECT(streamed == _content);
+}
+
+// Consumer interrupting loading, which completes with a failure.
+void TestStreamCancel(const std::string& _path) {
+  int chunks = 0;
+  bool done = false, success = true;
+  auto buffer = AsyncBuffer::Stream(
+      _path.c_str(),
+      [&](std::span<const std::byte>, size_t) { return ++chunks < 2; },
+      [&](bool _success, std::span<const std::byte>, const char*) {
+        done = true;
+        success = _success;
+      },
+      1 << 10);
+  FLIP_EXPECT(Pump(&done));
+  FLIP_EXPECT(!success);
+  FLIP_EXPECT(chunks == 2);
+}
+
+// Whole file loading, whose buffer is moved to completion.
+void TestTake(const std::string& _path,
+              const std::vector<std::byte>& _content) {
+  bool done = false, success = false;
+  std::vector<std::byte> loaded;
+  auto buffer = AsyncBuffer::Take(
+      _path.c_str(),
+      [&](bool _success, std::vector<std::byte>&& _buffer, const char*) {
+        done = true;
+        success = _success;
+        loaded = std::move(_buffer);
+      });
+  FLIP_EXPECT(Pump(&done));
+  FLIP_EXPECT(success);
+  FLIP_EXPECT(loaded == _content);
+}
+}  // namespace
+
+int main() {
+  // 4.5 chunks of 1KB file.
+  std::vector<std::byte> content;
+  for (int i = 0; i < 4608; ++i) {
+    content.push_back(static_cast<std::byte>(i * 7));
+  }
+  const auto path =
+      (std::filesystem::temp_directory_path() / "flip_loader_test.bin")
+          .string();
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(content.data()), content.size());
+  }
+
+  sfetch_setup(sfetch_desc_t{.max_requests = 8, .num_channels = 2,
+                             .num_lanes = 2});
+  TestStream(path, content);
+  TestStreamCancel(path);
+  TestTake(path, content);
+  sfetch_shutdown();
+
+  std::error_code error;
+  std::filesystem::remove(path, error);
+  return FLIP_TEST_RESULT();
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// Minimal headless test helpers. Failed expectations are reported, and make
+// the test return a failure from FLIP_TEST_RESULT.
+namespace flip::test {
+inline int& failures() {
+  static int failures = 0;
+  return failures;
+}
+}  // namespace flip::test
+
+#define FLIP_EXPECT(_condition)                                           \
+  do {                                                                    \
+    if (!(_condition)) {                                                  \
+      std::fprintf(stderr, "%s:%d: Expectation failed: %s\n", __FILE__,   \
+                   __LINE__, #_condition);                                \
+      ++flip::test::failures();                                           \
+    }                                                                     \
+  } while (false)
+
+#define FLIP_TEST_RESULT() \
+  (flip::test::failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE)